@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "batch.h"
+#include "dirwalk.h"
+#include "fileio.h"
+#include "globalstrings.h"
+#include "mainwindow.h"
+#include "settings.h"
+#include "stats.h"
+#include "stringutils.h"
+#include "textscan.h"
+#include "translation.h"
+
+#include <glib.h>
+#include <glibmm.h>
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include <config.h>
+
+namespace
+{
+
+enum BatchStatus
+{
+  STATUS_MATCH    = 0,
+  STATUS_NO_MATCH = 1,
+  STATUS_ERROR    = 2
+};
+
+// Milliseconds to wait for the directory walker in one go.
+enum { WALK_WAIT_INTERVAL = 100 };
+
+} // anonymous namespace
+
+namespace Regexxer
+{
+
+/**** Regexxer::Batch ******************************************************/
+
+Batch::Batch(const InitState& init)
+:
+  init_               (init),
+  file_pattern_       (),
+  pattern_            (),
+  fallback_encoding_  (Settings::instance()->get_string(conf_key_fallback_encoding)),
+  match_count_        (0),
+  error_count_        (0)
+{}
+
+Batch::~Batch()
+{}
+
+int Batch::run()
+{
+  if (init_.regex.empty())
+  {
+    print_error(_("No regular expression given to search for."));
+    return STATUS_ERROR;
+  }
+
+  std::string folder;
+
+  if (!init_.folder.empty())
+    folder = init_.folder.front();
+  if (!Glib::path_is_absolute(folder))
+    folder = Glib::build_filename(Glib::get_current_dir(), folder);
+
+  while (folder.size() > 1 && *folder.rbegin() == G_DIR_SEPARATOR)
+    folder.erase(folder.size() - 1);
+
+  try
+  {
+    file_pattern_ = Glib::Regex::create(
+        Util::shell_pattern_to_regex((init_.pattern.empty()) ? Glib::ustring(1, '*') : init_.pattern),
+        Glib::REGEX_DOTALL);
+  }
+  catch (const Glib::RegexError&)
+  {
+    print_error(_("The file search pattern is invalid."));
+    return STATUS_ERROR;
+  }
+
+  try
+  {
+    Glib::RegexCompileFlags flags = get_scan_compile_flags(init_.multiline);
+
+    if (init_.ignorecase)
+      flags |= Glib::REGEX_CASELESS;
+
+    if (Settings::instance()->get_boolean(conf_key_optimize_regex))
+      flags |= Glib::REGEX_OPTIMIZE;
+
+    pattern_ = Glib::Regex::create(init_.regex, flags);
+  }
+  catch (const Glib::RegexError& error)
+  {
+    print_error(error.what());
+    return STATUS_ERROR;
+  }
+
+  std::vector<std::string> files;
+  find_files(folder, files);
+
+  for (std::vector<std::string>::const_iterator p = files.begin(); p != files.end(); ++p)
+    process_file(*p);
+
+  if (error_count_ > 0)
+    return STATUS_ERROR;
+
+  return (match_count_ > 0) ? STATUS_MATCH : STATUS_NO_MATCH;
+}
+
+/**** Regexxer::Batch -- private *******************************************/
+
+/*
+ * Find the files the same way as the file tree does, and return them in
+ * the order they'd appear in it.
+ */
+void Batch::find_files(const std::string& folder, std::vector<std::string>& files)
+{
+  const Glib::RefPtr<Gio::Settings> settings = Settings::instance();
+
+  DirWalker walker (file_pattern_, !init_.no_recursive, init_.hidden);
+
+  walker.set_exclude_patterns(settings->get_string_array(conf_key_exclude_patterns));
+  walker.set_use_ignore_files(settings->get_boolean(conf_key_use_ignore_files));
+
+  ScopedTimer timer (STATS_WALK);
+
+  walker.start(folder);
+
+  WalkEntryList            entries;
+  std::list<Glib::ustring> errors;
+
+  for (bool more = true; more;)
+  {
+    more = walker.fetch(entries, errors, WALK_WAIT_INTERVAL);
+
+    // Collect errors but don't interrupt the search.
+    std::for_each(errors.begin(), errors.end(),
+                  sigc::mem_fun(*this, &Batch::print_error));
+    errors.clear();
+  }
+
+  sort_walk_entries(folder, entries);
+
+  files.reserve(files.size() + entries.size());
+
+  for (WalkEntryList::const_iterator p = entries.begin(); p != entries.end(); ++p)
+    files.push_back(p->fullname);
+}
+
+void Batch::process_file(const std::string& fullname)
+{
+  if (init_.in_place)
+  {
+    rewrite_file(fullname);
+    return;
+  }
+
+  std::string text;
+  std::string encoding;
+
+  try
+  {
+    load_text(fullname, fallback_encoding_, text, encoding);
+  }
+  catch (const Glib::Error& error)
+  {
+    print_error(error.what());
+    return;
+  }
+  catch (const ErrorBinaryFile&)
+  {
+    return; // silently skip binary files
+  }
+
+  ScanMatchList matches;
+  int           match_count = 0;
+
+  {
+    ScopedTimer timer (STATS_MATCH);
+
+    match_count = scan_text(pattern_, !init_.no_global, text, matches);
+
+    Stats::add_bytes(STATS_MATCH, text.size());
+    Stats::add_matches(match_count);
+  }
+
+  if (match_count == 0)
+    return;
+
+  match_count_ += match_count;
+
+  if (init_.feedback)
+  {
+    int last_line = -1;
+
+    for (ScanMatchList::const_iterator p = matches.begin(); p != matches.end(); ++p)
+    {
+      if (p->line == last_line)
+        continue;
+
+      print_location(fullname, p->line,
+                     Glib::ustring(text.begin() + p->line_begin, text.begin() + p->line_end));
+      last_line = p->line;
+    }
+  }
+}
+
+/*
+ * Substitute the matches while streaming the file into a temporary copy,
+ * so that even huge files don't have to be kept in memory as a whole.
+ */
+void Batch::rewrite_file(const std::string& fullname)
+{
+  sigc::slot<void, int, const Glib::ustring&> feedback;
+
+  if (init_.feedback)
+    feedback = sigc::bind<0>(sigc::ptr_fun(&print_location), fullname);
+
+  try
+  {
+    match_count_ += Regexxer::rewrite_file(fullname, fallback_encoding_, pattern_,
+                                           !init_.no_global, init_.substitution, feedback);
+  }
+  catch (const Glib::Error& error)
+  {
+    print_error(error.what());
+  }
+  catch (const ErrorBinaryFile&)
+  {} // silently skip binary files
+}
+
+void Batch::print_error(const Glib::ustring& message)
+{
+  ++error_count_;
+  g_printerr("%s: %s\n", g_get_prgname(), message.c_str());
+}
+
+/**** Regexxer -- batch output functions ***********************************/
+
+void print_location(const std::string& filename, int linenumber, const Glib::ustring& subject)
+{
+  std::cout << filename << ':' << linenumber + 1 << ':';
+
+  std::string charset;
+
+  if (Glib::get_charset(charset))
+    std::cout << subject.raw(); // charset is UTF-8
+  else
+    std::cout << Glib::convert_with_fallback(subject.raw(), charset, "UTF-8");
+
+  std::cout << '\n';
+}
+
+} // namespace Regexxer
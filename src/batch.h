@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef REGEXXER_BATCH_H_INCLUDED
+#define REGEXXER_BATCH_H_INCLUDED
+
+#include <glibmm/refptr.h>
+#include <glibmm/ustring.h>
+#include <string>
+#include <vector>
+
+namespace Glib { class Regex; }
+
+namespace Regexxer
+{
+
+struct InitState;
+
+/*
+ * The headless counterpart of MainWindow, used if --batch is given on the
+ * command line.  It runs the same find files, find matches, replace and
+ * save sequence as the GUI does, but works on plain text instead of
+ * FileBuffer objects and thus neither needs GTK+ nor a display.
+ */
+class Batch
+{
+public:
+  explicit Batch(const InitState& init);
+  ~Batch();
+
+  // Returns the exit status: 0 if there were matches, 1 if there were
+  // none, and 2 if an error occurred.
+  int run();
+
+private:
+  const InitState&          init_;
+  Glib::RefPtr<Glib::Regex> file_pattern_;
+  Glib::RefPtr<Glib::Regex> pattern_;
+  std::string               fallback_encoding_;
+  long                      match_count_;
+  int                       error_count_;
+
+  Batch(const Batch&);
+  Batch& operator=(const Batch&);
+
+  void find_files(const std::string& folder, std::vector<std::string>& files);
+  void process_file(const std::string& fullname);
+  void rewrite_file(const std::string& fullname);
+  void print_error(const Glib::ustring& message);
+};
+
+/*
+ * Print the location of a match to standard output, in the same
+ * "filename:line:text" format as grep -n uses.
+ */
+void print_location(const std::string& filename, int linenumber, const Glib::ustring& subject);
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_BATCH_H_INCLUDED */
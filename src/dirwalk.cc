@@ -0,0 +1,594 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "dirwalk.h"
+#include "ignorerules.h"
+#include "miscutils.h"
+#include "stringutils.h"
+#include "translation.h"
+
+#include <glibmm/convert.h>
+#include <glibmm/miscutils.h>
+#include <glibmm/regex.h>
+#include <glibmm/timeval.h>
+#include <algorithm>
+#include <cerrno>
+#include <deque>
+#include <map>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <config.h>
+
+namespace
+{
+
+// Number of entries collected by the walker thread before they are
+// made available to fetch().
+enum { BATCH_SIZE = 256 };
+
+// Reading directories mostly means waiting for the disk or the network,
+// so it pays to have more threads than processors, up to this limit.
+enum { MAX_THREADS = 16 };
+
+// Milliseconds an idle thread sleeps before it looks for work again,
+// in case it missed the wakeup.
+enum { IDLE_INTERVAL = 10 };
+
+enum EntryType
+{
+  ENTRY_OTHER,
+  ENTRY_DIRECTORY,
+  ENTRY_REGULAR
+};
+
+static
+gint64 get_file_size(const std::string& fullname)
+{
+  struct stat info;
+
+  if (lstat(fullname.c_str(), &info) < 0)
+    return 0;
+
+  return info.st_size;
+}
+
+/*
+ * Determine the type of a directory entry without following symbolic
+ * links.  Use the type readdir() provides if possible, and fall back to
+ * a single lstat() otherwise.
+ */
+static
+EntryType get_entry_type(const struct dirent* entry, const std::string& fullname)
+{
+#ifdef _DIRENT_HAVE_D_TYPE
+  switch (entry->d_type)
+  {
+    case DT_DIR: return ENTRY_DIRECTORY;
+    case DT_REG: return ENTRY_REGULAR;
+    case DT_UNKNOWN: break;
+    default: return ENTRY_OTHER;
+  }
+#endif
+  struct stat info;
+
+  if (lstat(fullname.c_str(), &info) < 0)
+    return ENTRY_OTHER;
+
+  if (S_ISDIR(info.st_mode))
+    return ENTRY_DIRECTORY;
+
+  if (S_ISREG(info.st_mode))
+    return ENTRY_REGULAR;
+
+  return ENTRY_OTHER;
+}
+
+typedef std::vector<std::string>         SortKey;
+typedef std::map<std::string, SortKey>   DirKeyMap;
+
+struct SortItem
+{
+  const SortKey*              dirkey;
+  const Regexxer::WalkEntry*  entry;
+};
+
+/*
+ * Return the collate keys of the directories on the path from toplevel
+ * down to dirname, which are built recursively and cached in dirkeys.
+ */
+static
+const SortKey& get_dir_sort_key(const std::string& dirname, const std::string& toplevel,
+                                DirKeyMap& dirkeys)
+{
+  const DirKeyMap::iterator pos = dirkeys.find(dirname);
+
+  if (pos != dirkeys.end())
+    return pos->second;
+
+  SortKey key;
+  const std::string parent = Glib::path_get_dirname(dirname);
+
+  if (dirname != toplevel && parent.size() < dirname.size())
+  {
+    key = get_dir_sort_key(parent, toplevel, dirkeys); // recurse
+    key.push_back('0' + Glib::filename_display_basename(dirname).collate_key());
+  }
+
+  return dirkeys.insert(DirKeyMap::value_type(dirname, key)).first->second;
+}
+
+/*
+ * Compare the paths component by component.  Since the collate keys of
+ * directories start with '0' and those of files with '1', the files of a
+ * directory end up after all of its subdirectories.
+ */
+static
+bool sort_item_less(const SortItem& a, const SortItem& b)
+{
+  const SortKey& akey = *a.dirkey;
+  const SortKey& bkey = *b.dirkey;
+
+  const SortKey::size_type common = std::min(akey.size(), bkey.size());
+
+  for (SortKey::size_type i = 0; i < common; ++i)
+  {
+    if (akey[i] != bkey[i])
+      return (akey[i] < bkey[i]);
+  }
+
+  const std::string& anext = (akey.size() > common) ? akey[common] : a.entry->collate_key;
+  const std::string& bnext = (bkey.size() > common) ? bkey[common] : b.entry->collate_key;
+
+  if (anext != bnext)
+    return (anext < bnext);
+
+  // Keep the order deterministic even if the collate keys are equal.
+  return (a.entry->fullname < b.entry->fullname);
+}
+
+} // anonymous namespace
+
+namespace Regexxer
+{
+
+/**** Regexxer -- DirWalker utilities ************************************/
+
+void sort_walk_entries(const std::string& toplevel, WalkEntryList& entries)
+{
+  DirKeyMap             dirkeys;
+  std::vector<SortItem> items;
+
+  items.reserve(entries.size());
+
+  for (WalkEntryList::const_iterator p = entries.begin(); p != entries.end(); ++p)
+  {
+    const SortItem item = { &get_dir_sort_key(p->dirname, toplevel, dirkeys), &*p };
+    items.push_back(item);
+  }
+
+  std::sort(items.begin(), items.end(), &sort_item_less);
+
+  WalkEntryList sorted;
+  sorted.reserve(entries.size());
+
+  for (std::vector<SortItem>::const_iterator p = items.begin(); p != items.end(); ++p)
+    sorted.push_back(*p->entry);
+
+  entries.swap(sorted);
+}
+
+/**** Regexxer::DirWalker::Worker ******************************************/
+
+/*
+ * The directories queued by a single thread.  The owner takes directories
+ * from the back, which results in a depth-first walk with good locality,
+ * while other threads steal from the front, where the directories closest
+ * to the toplevel -- and thus the biggest chunks of work -- are found.
+ */
+struct DirWalker::Worker
+{
+  Glib::Mutex                 mutex;
+  std::deque<DirItem>         queue;
+  std::vector<IgnoreRules*>   rules; // owned, not locked
+};
+
+/**** Regexxer::DirWalker **************************************************/
+
+DirWalker::DirWalker(const Glib::RefPtr<Glib::Regex>& pattern, bool recursive, bool hidden)
+:
+  pattern_          (pattern),
+  exclude_pattern_  (),
+  recursive_        (recursive),
+  hidden_           (hidden),
+  use_ignore_files_ (false),
+  workers_    (),
+  threads_    (),
+  mutex_      (),
+  cond_found_ (),
+  entries_    (),
+  errors_     (),
+  finished_   (false),
+  idle_mutex_ (),
+  cond_idle_  (),
+  idle_count_ (0),
+  pending_    (0),
+  running_    (0),
+  cancelled_  (0)
+{}
+
+DirWalker::~DirWalker()
+{
+  cancel();
+
+  for (std::vector<Glib::Thread*>::const_iterator p = threads_.begin(); p != threads_.end(); ++p)
+    (*p)->join();
+
+  for (std::vector<Worker*>::const_iterator p = workers_.begin(); p != workers_.end(); ++p)
+  {
+    typedef std::vector<IgnoreRules*>::const_iterator RulesIterator;
+
+    for (RulesIterator prules = (*p)->rules.begin(); prules != (*p)->rules.end(); ++prules)
+      delete *prules;
+
+    delete *p;
+  }
+}
+
+void DirWalker::set_exclude_patterns(const std::vector<Glib::ustring>& patterns)
+{
+  g_return_if_fail(workers_.empty());
+
+  if (patterns.empty())
+  {
+    exclude_pattern_.reset();
+    return;
+  }
+
+  try
+  {
+    exclude_pattern_ = Glib::Regex::create(Util::shell_patterns_to_regex(patterns),
+                                           Glib::REGEX_DOTALL);
+  }
+  catch (const Glib::RegexError& error)
+  {
+    g_warning("Ignoring invalid exclude pattern: %s", error.what().c_str());
+  }
+}
+
+void DirWalker::set_use_ignore_files(bool use_ignore_files)
+{
+  g_return_if_fail(workers_.empty());
+
+  use_ignore_files_ = use_ignore_files;
+}
+
+void DirWalker::start(const std::string& dirname)
+{
+  g_return_if_fail(workers_.empty());
+
+  // Without recursion there is only a single directory to read.
+  const int thread_count = (recursive_)
+      ? std::min(2 * Util::get_processor_count(), int(MAX_THREADS)) : 1;
+
+  for (int i = 0; i < thread_count; ++i)
+    workers_.push_back(new Worker());
+
+  workers_.front()->queue.push_back(DirItem(dirname, 0));
+
+  g_atomic_int_set(&pending_, 1);
+  g_atomic_int_set(&running_, thread_count);
+
+  int started = 0;
+
+  try
+  {
+    for (; started < thread_count; ++started)
+      threads_.push_back(Glib::Thread::create(
+          sigc::bind(sigc::mem_fun(*this, &DirWalker::run), started), true));
+  }
+  catch (...)
+  {
+    // Stop the threads already running, and account for the ones which
+    // never ran, so that fetch() doesn't wait for them forever.
+    cancel();
+
+    for (; started < thread_count; ++started)
+      exit_thread();
+
+    throw;
+  }
+}
+
+void DirWalker::cancel()
+{
+  g_atomic_int_set(&cancelled_, 1);
+}
+
+bool DirWalker::fetch(WalkEntryList& entries, std::list<Glib::ustring>& errors,
+                      unsigned int timeout_ms)
+{
+  Glib::TimeVal abs_time;
+  abs_time.assign_current_time();
+  abs_time.add_milliseconds(timeout_ms);
+
+  Glib::Mutex::Lock lock (mutex_);
+
+  while (entries_.empty() && errors_.empty() && !finished_)
+  {
+    if (!cond_found_.timed_wait(mutex_, abs_time))
+      break;
+  }
+
+  if (entries.empty())
+    entries.swap(entries_);
+  else
+    entries.insert(entries.end(), entries_.begin(), entries_.end());
+
+  entries_.clear();
+  errors.splice(errors.end(), errors_);
+
+  return !finished_;
+}
+
+/**** Regexxer::DirWalker -- private ***************************************/
+
+/*
+ * Everything from here on is executed on the walker threads.  Only
+ * thread-safe GLib functionality must be used.
+ */
+void DirWalker::run(int index)
+{
+  WalkEntryList batch;
+  DirItem       item;
+
+  while (next_directory(index, item, batch))
+  {
+    walk(index, item, batch);
+
+    if (batch.size() >= BATCH_SIZE)
+      flush(batch);
+
+    // The subdirectories have been queued already, thus the count
+    // drops to zero only after the very last directory.
+    if (g_atomic_int_dec_and_test(&pending_))
+    {
+      Glib::Mutex::Lock lock (idle_mutex_);
+      cond_idle_.broadcast();
+    }
+  }
+
+  flush(batch);
+  exit_thread();
+}
+
+/*
+ * Called once for every walker thread when it is done.  The last one to
+ * exit marks the walk as finished.
+ */
+void DirWalker::exit_thread()
+{
+  if (g_atomic_int_dec_and_test(&running_))
+  {
+    Glib::Mutex::Lock lock (mutex_);
+
+    finished_ = true;
+    cond_found_.broadcast();
+  }
+}
+
+/*
+ * Take the next directory from the thread's own queue, or steal one from
+ * another thread.  Returns false when the walk is complete or cancelled.
+ */
+bool DirWalker::next_directory(int index, DirItem& item, WalkEntryList& batch)
+{
+  const int thread_count = workers_.size();
+
+  while (!g_atomic_int_get(&cancelled_))
+  {
+    {
+      Worker& own = *workers_[index];
+      Glib::Mutex::Lock lock (own.mutex);
+
+      if (!own.queue.empty())
+      {
+        item.first.swap(own.queue.back().first);
+        item.second = own.queue.back().second;
+        own.queue.pop_back();
+        return true;
+      }
+    }
+
+    for (int i = 1; i < thread_count; ++i)
+    {
+      Worker& victim = *workers_[(index + i) % thread_count];
+      Glib::Mutex::Lock lock (victim.mutex);
+
+      if (!victim.queue.empty())
+      {
+        item.first.swap(victim.queue.front().first);
+        item.second = victim.queue.front().second;
+        victim.queue.pop_front();
+        return true;
+      }
+    }
+
+    if (g_atomic_int_get(&pending_) == 0)
+      break;
+
+    // Hand over what has been found so far before going to sleep.
+    flush(batch);
+
+    Glib::TimeVal abs_time;
+    abs_time.assign_current_time();
+    abs_time.add_milliseconds(IDLE_INTERVAL);
+
+    Glib::Mutex::Lock lock (idle_mutex_);
+
+    g_atomic_int_inc(&idle_count_);
+    cond_idle_.timed_wait(idle_mutex_, abs_time);
+    g_atomic_int_add(&idle_count_, -1);
+  }
+
+  return false;
+}
+
+void DirWalker::walk(int index, const DirItem& item, WalkEntryList& batch)
+{
+  const std::string& dirname = item.first;
+  DIR *const dir = opendir(dirname.c_str());
+
+  if (!dir)
+  {
+    const int error_code = errno;
+
+    // Collect errors but don't interrupt the search.
+    add_error(Util::compose(_("Failed to open directory \342\200\234%1\342\200\235: %2"),
+                            Glib::filename_display_name(dirname), g_strerror(error_code)));
+    return;
+  }
+
+  // The directory has to be read completely before anything can be
+  // filtered, since the ignore files apply to their siblings.
+  std::vector< std::pair<std::string, EntryType> > candidates;
+  bool has_ignore_file = false;
+
+  while (const struct dirent *const entry = readdir(dir))
+  {
+    if (g_atomic_int_get(&cancelled_))
+      break;
+
+    const char *const filename = entry->d_name;
+
+    if (filename[0] == '.' && (filename[1] == '\0' || (filename[1] == '.' && filename[2] == '\0')))
+      continue;
+
+    if (use_ignore_files_ && IgnoreRules::is_ignore_file(filename))
+      has_ignore_file = true;
+
+    if (!hidden_ && filename[0] == '.')
+      continue;
+
+    const std::string fullname = Glib::build_filename(dirname, filename);
+    const EntryType   type     = get_entry_type(entry, fullname);
+
+    // Ignore symbolic links and special files.
+    if (type == ENTRY_REGULAR || (type == ENTRY_DIRECTORY && recursive_))
+      candidates.push_back(std::make_pair(fullname, type));
+  }
+
+  closedir(dir);
+
+  const IgnoreRules* rules = item.second;
+
+  if (has_ignore_file)
+  {
+    if (IgnoreRules *const own_rules = IgnoreRules::load(dirname, rules))
+    {
+      workers_[index]->rules.push_back(own_rules);
+      rules = own_rules;
+    }
+  }
+
+  std::vector<DirItem> subdirs;
+
+  for (std::vector< std::pair<std::string, EntryType> >::const_iterator p = candidates.begin();
+       p != candidates.end(); ++p)
+  {
+    const std::string& fullname = p->first;
+    const bool         is_dir   = (p->second == ENTRY_DIRECTORY);
+
+    if (rules && rules->is_ignored(fullname, is_dir))
+      continue;
+
+    if (is_dir && !exclude_pattern_)
+    {
+      subdirs.push_back(DirItem(fullname, rules));
+      continue;
+    }
+
+    const Glib::ustring basename = Glib::filename_display_basename(fullname);
+
+    if (exclude_pattern_ && exclude_pattern_->match(basename))
+      continue;
+
+    if (is_dir)
+    {
+      subdirs.push_back(DirItem(fullname, rules));
+    }
+    else if (pattern_->match(basename))
+    {
+      batch.push_back(WalkEntry());
+      batch.back().dirname  = dirname;
+      batch.back().fullname = fullname;
+      batch.back().basename = basename;
+      batch.back().collate_key = '1' + basename.collate_key();
+      batch.back().size     = get_file_size(fullname);
+    }
+  }
+
+  if (!subdirs.empty())
+    push_directories(index, subdirs);
+}
+
+void DirWalker::push_directories(int index, const std::vector<DirItem>& items)
+{
+  g_atomic_int_add(&pending_, items.size());
+
+  {
+    Worker& own = *workers_[index];
+    Glib::Mutex::Lock lock (own.mutex);
+
+    // Queue in reverse so that the owner continues with the first one.
+    own.queue.insert(own.queue.end(), items.rbegin(), items.rend());
+  }
+
+  if (g_atomic_int_get(&idle_count_) > 0)
+  {
+    Glib::Mutex::Lock lock (idle_mutex_);
+    cond_idle_.broadcast();
+  }
+}
+
+void DirWalker::flush(WalkEntryList& batch)
+{
+  if (batch.empty())
+    return;
+
+  Glib::Mutex::Lock lock (mutex_);
+
+  entries_.insert(entries_.end(), batch.begin(), batch.end());
+  batch.clear();
+
+  cond_found_.broadcast();
+}
+
+void DirWalker::add_error(const Glib::ustring& message)
+{
+  Glib::Mutex::Lock lock (mutex_);
+
+  errors_.push_back(message);
+  cond_found_.broadcast();
+}
+
+} // namespace Regexxer
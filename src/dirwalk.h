@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef REGEXXER_DIRWALK_H_INCLUDED
+#define REGEXXER_DIRWALK_H_INCLUDED
+
+#include <glib.h>
+#include <glibmm/refptr.h>
+#include <glibmm/thread.h>
+#include <glibmm/ustring.h>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Glib { class Regex; }
+
+namespace Regexxer
+{
+
+class IgnoreRules;
+
+/*
+ * A regular file found by DirWalker.  The dirname is the full name of the
+ * directory the file was found in, exactly as it was built by the walk, so
+ * it can be used as a key to look up the directory.  The collate key of
+ * the basename is prefixed with '1', while those of directories have a
+ * leading '0', so that directories always come first.  The size is that
+ * of the file at the time it was found, or 0 if it couldn't be determined.
+ */
+struct WalkEntry
+{
+  std::string   dirname;
+  std::string   fullname;
+  Glib::ustring basename; // display name
+  std::string   collate_key;
+  gint64        size;
+};
+
+typedef std::vector<WalkEntry> WalkEntryList;
+
+/*
+ * Sort the entries found below toplevel into the order of the file tree,
+ * where each directory lists its subdirectories first and then its files,
+ * both ordered by collate key.
+ */
+void sort_walk_entries(const std::string& toplevel, WalkEntryList& entries);
+
+/*
+ * Search a directory tree for files whose display name matches pattern,
+ * on a bounded pool of threads.  Each thread reads one directory at a time
+ * and queues its subdirectories locally; idle threads steal directories
+ * from the others.  Symbolic links are never followed, and every directory
+ * entry costs at most one lstat() -- none if readdir() already reports the
+ * file type -- plus another one for the size of each matching file, which
+ * the progress display is based on.  The results are handed over in batches
+ * by fetch(), so that the GUI thread can stay responsive in the meantime.
+ * The order of the results is not defined; FileTree sorts them anyway.
+ */
+class DirWalker
+{
+public:
+  DirWalker(const Glib::RefPtr<Glib::Regex>& pattern, bool recursive, bool hidden);
+  ~DirWalker(); // cancels the walk and waits for the thread to exit
+
+  // Skip files and whole directories whose name matches any of the shell
+  // patterns.  Must be called before start().
+  void set_exclude_patterns(const std::vector<Glib::ustring>& patterns);
+
+  // Honor the .gitignore and .ignore files in the directory tree, which
+  // prune ignored directories before they are even read.  Must be called
+  // before start().
+  void set_use_ignore_files(bool use_ignore_files);
+
+  void start(const std::string& dirname);
+  void cancel();
+
+  // Wait up to timeout_ms for results to become available, and append
+  // everything found so far to entries and errors.  Returns false once
+  // the walk has finished and all results have been fetched.
+  bool fetch(WalkEntryList& entries, std::list<Glib::ustring>& errors,
+             unsigned int timeout_ms);
+
+private:
+  struct Worker;
+  typedef std::pair<std::string, const IgnoreRules*> DirItem;
+
+  Glib::RefPtr<Glib::Regex>   pattern_;
+  Glib::RefPtr<Glib::Regex>   exclude_pattern_;
+  bool                        recursive_;
+  bool                        hidden_;
+  bool                        use_ignore_files_;
+  std::vector<Worker*>        workers_;
+  std::vector<Glib::Thread*>  threads_;
+  Glib::Mutex                 mutex_;
+  Glib::Cond                  cond_found_;
+  WalkEntryList               entries_;
+  std::list<Glib::ustring>    errors_;
+  bool                        finished_;
+  Glib::Mutex                 idle_mutex_;
+  Glib::Cond                  cond_idle_;
+  volatile gint               idle_count_;
+  volatile gint               pending_;   // directories queued or being read
+  volatile gint               running_;   // threads not yet exited
+  volatile gint               cancelled_;
+
+  DirWalker(const DirWalker&);
+  DirWalker& operator=(const DirWalker&);
+
+  void run(int index);
+  void exit_thread();
+  bool next_directory(int index, DirItem& item, WalkEntryList& batch);
+  void walk(int index, const DirItem& item, WalkEntryList& batch);
+  void push_directories(int index, const std::vector<DirItem>& items);
+  void flush(WalkEntryList& batch);
+  void add_error(const Glib::ustring& message);
+};
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_DIRWALK_H_INCLUDED */
@@ -22,6 +22,8 @@
 #include "filebufferundo.h"
 #include "globalstrings.h"
 #include "miscutils.h"
+#include "progress.h"
+#include "stats.h"
 #include "stringutils.h"
 #include "translation.h"
 #include "settings.h"
@@ -36,8 +38,6 @@
 namespace
 {
 
-enum { PULSE_INTERVAL = 128 };
-
 class RegexxerTags : public Gtk::TextTagTable
 {
 public:
@@ -161,14 +161,19 @@ public:
 FileBuffer::FileBuffer()
 :
   Gsv::Buffer(Glib::RefPtr<Gtk::TextTagTable>(RegexxerTags::instance())),
-  match_set_            (),
-  current_match_        (match_set_.end()),
+  matches_              (),
+  current_match_        (-1),
+  current_mark_         (),
+  highlight_begin_      (),
+  highlight_end_        (),
+  dirty_ranges_         (),
+  scan_pattern_         (),
+  scan_multiple_        (false),
   user_action_stack_    (),
   weak_undo_stack_      (),
-  match_count_          (0),
-  original_match_count_ (0),
   stamp_modified_       (0),
   stamp_saved_          (0),
+  stamp_changed_        (0),
   cached_bound_state_   (BOUND_FIRST | BOUND_LAST),
   match_removed_        (false),
   locked_               (false)
@@ -241,7 +246,7 @@ void FileBuffer::pango_context_changed(const Glib::RefPtr<Pango::Context>& conte
 
 bool FileBuffer::is_freeable() const
 {
-  return (!locked_ && match_count_ == 0 && stamp_modified_ == 0 && stamp_saved_ == 0);
+  return (!locked_ && matches_.get_live_count() == 0 && stamp_modified_ == 0 && stamp_saved_ == 0);
 }
 
 bool FileBuffer::in_user_action() const
@@ -250,113 +255,127 @@ bool FileBuffer::in_user_action() const
 }
 
 /*
- * Apply pattern on all lines in the buffer and return the number of matches.
+ * Apply pattern on the buffer text and return the number of matches.
  * If multiple is false then every line is matched only once, otherwise
  * multiple matches per line will be found (like modifier /g in Perl).
+ * Matches of a multiline pattern may span several lines.  If the buffer has
+ * been searched for the same pattern before, and it isn't multiline, only
+ * the lines changed since are scanned again, unless feedback is requested
+ * for every match.
  */
 int FileBuffer::find_matches(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
-                             const sigc::slot<void, int, const Glib::ustring&>& feedback)
+                             const sigc::slot<void, int, const Glib::ustring&>& feedback,
+                             ProgressReporter* progress)
 {
-  ScopedLock lock (*this);
+  if (!feedback && can_rescan(pattern, multiple))
+    return rescan_matches();
 
-  const Glib::RefPtr<RegexxerTags> tagtable = RegexxerTags::instance();
+  // Scanning a snapshot of the text is a lot faster than extracting and
+  // matching every single line of the buffer.
+  const std::string text = get_text().raw();
+  ScanMatchList     matches;
 
-  notify_weak_undos();
-  forget_current_match();
-  remove_tag(tagtable->match, begin(), end());
+  {
+    ScopedTimer timer (STATS_MATCH);
 
-  while (!match_set_.empty())
-    delete_mark((*match_set_.begin())->mark); // triggers on_mark_deleted()
+    Stats::add_bytes(STATS_MATCH, text.size());
+    Stats::add_matches(scan_text(pattern, multiple, text, matches,
+                                 (progress) ? sigc::mem_fun(*progress, &ProgressReporter::poll)
+                                            : sigc::slot<bool>()));
+  }
 
-  g_return_val_if_fail(match_count_ == 0, 0);
-  original_match_count_ = 0;
+  return install_matches(pattern, multiple, text, matches, feedback, progress);
+}
 
-  unsigned int iteration = 0;
+/*
+ * Replace the current matches with the result of scan_text(), which has
+ * been computed from text, a snapshot of the buffer contents, possibly
+ * outside the GUI thread.
+ */
+int FileBuffer::install_matches(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                                const std::string& text, const ScanMatchList& matches,
+                                const sigc::slot<void, int, const Glib::ustring&>& feedback,
+                                ProgressReporter* progress)
+{
+  ScopedLock  lock  (*this);
+  ScopedTimer timer (STATS_BUFFER);
 
-  for (iterator line = begin(); !line.is_end(); line.forward_line())
-  {
-    iterator line_end = line;
+  remove_all_matches();
+  g_return_val_if_fail(matches_.get_live_count() == 0, 0);
 
-    if (!line_end.ends_line())
-      line_end.forward_to_line_end();
+  int subject_line = -1;
 
-    const Glib::ustring subject = get_slice(line, line_end);
-    int  offset = 0;
-    bool last_was_empty = false;
+  ScanMatchList::const_iterator pmatch = matches.begin();
 
-    do
-    {
-      if ((++iteration % PULSE_INTERVAL) == 0 && signal_pulse()) // emit
-      {
-        signal_match_count_changed(); // emit
-        return match_count_;
-      }
+  for (; pmatch != matches.end(); ++pmatch)
+  {
+    if (progress && progress->poll())
+      break;
 
-      Glib::MatchInfo match_info;
-      bool is_matched =
-        pattern->match(subject, offset, match_info,
-                       (last_was_empty) ? Glib::REGEX_MATCH_ANCHORED | Glib::REGEX_MATCH_NOTEMPTY
-                                        : static_cast<Glib::RegexMatchFlags>(0));
-      if (!is_matched)
-      {
-        if (last_was_empty && unsigned(offset) < subject.bytes())
-        {
-          const std::string::const_iterator pbegin = subject.begin().base();
-          Glib::ustring::const_iterator     poffset (pbegin + offset);
-
-          offset = (++poffset).base() - pbegin; // forward one UTF-8 character
-          last_was_empty = false;
-          continue;
-        }
-        break;
-      }
+    const std::pair<int, int> bounds = pmatch->captures.front();
+    const char *const         line   = text.data() + pmatch->line_begin;
 
-      ++match_count_;
-      ++original_match_count_;
+    const iterator start  = get_iter_at_line_index(pmatch->line, bounds.first);
+    const int      length = g_utf8_strlen(line + bounds.first, bounds.second - bounds.first);
 
-      std::pair<int, int> bounds;
-      match_info.fetch_pos(0, bounds.first, bounds.second);
+    // Tagging every single match would be slow, so the highlighting is
+    // left to apply_tag_highlight_range() which deals with the visible part.
+    matches_.append(start.get_offset(), length, pmatch->captures);
 
-      iterator start = line;
-      iterator stop  = line;
+    if (pmatch->line != subject_line && feedback)
+      feedback(pmatch->line, Glib::ustring(text.begin() + pmatch->line_begin,
+                                           text.begin() + pmatch->line_end));
 
-      start.set_line_index(bounds.first);
-      stop .set_line_index(bounds.second);
+    subject_line = pmatch->line;
+  }
 
-      const MatchDataPtr match (new MatchData(
-          original_match_count_, subject, match_info));
+  // Only a complete set of matches can be updated incrementally.  The scan
+  // that produced them might have been cancelled as well.
+  const bool is_complete = (pmatch == matches.end() && !(progress && progress->is_cancelled()));
 
-      match_set_.insert(match_set_.end(), match);
-      match->install_mark(start);
+  dirty_ranges_.clear();
+  scan_pattern_  = (is_complete) ? pattern : Glib::RefPtr<Glib::Regex>();
+  scan_multiple_ = multiple;
 
-      apply_tag(tagtable->match, start, stop);
+  apply_tag_highlight_range();
 
-      if (offset == 0 && feedback)
-        feedback(line.get_line(), subject);
+  signal_match_count_changed(); // emit
+  return matches_.get_live_count();
+}
 
-      last_was_empty = (bounds.first == bounds.second);
-      offset = bounds.second;
-    }
-    while (multiple);
-  }
+bool FileBuffer::can_rescan(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple) const
+{
+  // A match of a multiline pattern might start in an unchanged line and
+  // reach into a changed one, or even further, which the lines around the
+  // changes don't tell.  So these always get a full search.
+  if (is_multiline_pattern(pattern))
+    return false;
+
+  // The rescan is done on the GUI thread, so leave larger changes to a full
+  // search, which can be run on a worker thread.
+  return (scan_pattern_ && scan_multiple_ == multiple && is_same_pattern(scan_pattern_, pattern)
+          && dirty_ranges_.get_size() <= get_char_count() / 4);
+}
 
-  signal_match_count_changed(); // emit
-  return match_count_;
+unsigned long FileBuffer::get_change_stamp() const
+{
+  return stamp_changed_;
 }
 
 int FileBuffer::get_match_count() const
 {
-  return match_count_;
+  return matches_.get_live_count();
 }
 
 int FileBuffer::get_match_index() const
 {
-  return (!match_removed_ && current_match_ != match_set_.end()) ? (*current_match_)->index : 0;
+  // The slots are numbered in the order the matches were found.
+  return (!match_removed_ && current_match_ >= 0) ? current_match_ + 1 : 0;
 }
 
 int FileBuffer::get_original_match_count() const
 {
-  return original_match_count_;
+  return matches_.get_slot_count();
 }
 
 /*
@@ -374,18 +393,18 @@ Glib::RefPtr<FileBuffer::Mark> FileBuffer::get_next_match(bool move_forward)
 
   if (move_forward && !match_removed_)
   {
-    if (current_match_ != match_set_.end())
-      ++current_match_;
+    if (current_match_ >= 0)
+      current_match_ = matches_.next_live(current_match_);
     else
-      current_match_ = match_set_.begin();
+      current_match_ = matches_.first_live();
   }
 
   if (!move_forward)
   {
-    if (current_match_ != match_set_.begin())
-      --current_match_;
+    if (current_match_ >= 0)
+      current_match_ = matches_.prev_live(current_match_);
     else
-      current_match_ = match_set_.end();
+      current_match_ = matches_.last_live();
   }
 
   // See above; we can now safely reset this flag.
@@ -394,7 +413,8 @@ Glib::RefPtr<FileBuffer::Mark> FileBuffer::get_next_match(bool move_forward)
   apply_tag_current();
   update_bound_state();
 
-  return (current_match_ != match_set_.end()) ? (*current_match_)->mark : Glib::RefPtr<Mark>();
+  // The mark has been moved to the current match by apply_tag_current().
+  return (current_match_ >= 0) ? current_mark_ : Glib::RefPtr<Mark>();
 }
 
 /*
@@ -405,7 +425,7 @@ Glib::RefPtr<FileBuffer::Mark> FileBuffer::get_next_match(bool move_forward)
 void FileBuffer::forget_current_match()
 {
   remove_tag_current();
-  current_match_ = match_set_.end();
+  current_match_ = -1;
   match_removed_ = false;
 }
 
@@ -413,16 +433,16 @@ BoundState FileBuffer::get_bound_state()
 {
   BoundState bound = BOUND_NONE;
 
-  if (match_set_.empty())
+  if (matches_.get_live_count() == 0)
   {
     bound = BOUND_FIRST | BOUND_LAST;
   }
-  else if (current_match_ != match_set_.end())
+  else if (current_match_ >= 0)
   {
-    if (current_match_ == match_set_.begin())
+    if (current_match_ == matches_.first_live())
       bound |= BOUND_FIRST;
 
-    if (!match_removed_ && current_match_ == --match_set_.end())
+    if (!match_removed_ && current_match_ == matches_.last_live())
       bound |= BOUND_LAST;
   }
 
@@ -438,7 +458,7 @@ BoundState FileBuffer::get_bound_state()
  */
 void FileBuffer::replace_current_match(const Glib::ustring& substitution)
 {
-  if (!match_removed_ && current_match_ != match_set_.end())
+  if (!match_removed_ && current_match_ >= 0)
   {
     ScopedUserAction action (*this);
 
@@ -446,20 +466,113 @@ void FileBuffer::replace_current_match(const Glib::ustring& substitution)
   }
 }
 
-void FileBuffer::replace_all_matches(const Glib::ustring& substitution)
+/*
+ * Replace all matches in one go.  Instead of editing the buffer match by
+ * match, which triggers a cascade of signal emissions and undo actions for
+ * every single one, the new text is assembled first and then swapped in.
+ * A single undo action restores the old text together with the matches.
+ * The progress is reported match by match, as the bytes of the text passed
+ * so far.  If the operation is cancelled through the progress reporter,
+ * nothing changes.
+ */
+void FileBuffer::replace_all_matches(const Glib::ustring& substitution, ProgressReporter* progress)
 {
-  ScopedLock lock (*this);
-  ScopedUserAction action (*this);
+  g_return_if_fail(!in_user_action());
+
+  if (matches_.get_live_count() == 0)
+    return;
+
+  ScopedLock  lock  (*this);
+  ScopedTimer timer (STATS_REPLACE);
+
+  const Glib::ustring old_text = get_text();
+  std::string         new_text;
+  MatchSlotList       removed;
 
-  unsigned int iteration = 0;
+  new_text.reserve(old_text.bytes());
+  removed.reserve(matches_.get_live_count());
 
-  while (!match_set_.empty())
+  const char* pos        = old_text.data();
+  int         pos_offset = 0;
+
+  Glib::ustring       subject;
+  int                 subject_line = -1;
+  int                 subject_last = -1;
+  Util::CaptureVector captures;
+
+  for (int slot = matches_.first_live(); slot >= 0; slot = matches_.next_live(slot))
   {
-    replace_match(match_set_.begin(), substitution);
+    if (progress && progress->poll())
+      return;
+
+    const int         offset      = matches_.get_offset(slot);
+    const int         length      = matches_.get_length(slot);
+    const char *const match_begin = g_utf8_offset_to_pointer(pos, offset - pos_offset);
+    const char *const match_end   = g_utf8_offset_to_pointer(match_begin, length);
+
+    const iterator start = get_iter_at_offset(offset);
+    iterator       stop  = start;
+    stop.forward_chars(length);
+
+    // Slice the subject out of the old text only once for all the matches
+    // in the same line, rather than fetching it from the buffer each time.
+    // Matches spanning several lines have a longer subject, though.
+    if (start.get_line() != subject_line || stop.get_line() != subject_last)
+    {
+      iterator line_end = stop;
 
-    if ((++iteration % PULSE_INTERVAL) == 0 && signal_pulse()) // emit
-      break;
+      if (!line_end.ends_line())
+        line_end.forward_to_line_end();
+
+      subject.assign(match_begin - start.get_line_index(),
+                     match_end + (line_end.get_line_index() - stop.get_line_index()));
+
+      subject_line = start.get_line();
+      subject_last = stop.get_line();
+    }
+
+    matches_.get_captures(slot, start.get_line_index(), subject.raw(), captures);
+
+    new_text.append(pos, match_begin);
+    new_text += Util::substitute_references(substitution, subject, captures).raw();
+
+    if (progress)
+    {
+      progress->add_bytes_done(match_end - pos);
+      progress->add_matches(1);
+    }
+
+    pos        = match_end;
+    pos_offset = offset + length;
+
+    removed.push_back(std::make_pair(slot, offset));
   }
+
+  new_text.append(pos, old_text.data() + old_text.bytes());
+
+  if (progress)
+    progress->add_bytes_done(old_text.data() + old_text.bytes() - pos);
+
+  remove_tag_current();
+
+  for (MatchSlotList::const_iterator p = removed.begin(); p != removed.end(); ++p)
+    matches_.remove(p->first);
+
+  if (current_match_ >= 0)
+  {
+    current_match_ = -1;
+    match_removed_ = true;
+  }
+
+  // Outside of a user action, this doesn't record any undo actions.
+  replace_text(new_text);
+
+  signal_undo_stack_push(UndoActionPtr(
+      new FileBufferActionReplaceAll(*this, old_text, removed))); // emit
+
+  signal_preview_line_changed.queue();
+  signal_match_count_changed(); // emit
+  update_bound_state();
 }
 
 /*
@@ -474,16 +587,14 @@ int FileBuffer::get_line_preview(const Glib::ustring& substitution, Glib::ustrin
   int position = -1;
   Glib::ustring result;
 
-  if (!match_removed_ && current_match_ != match_set_.end())
+  if (!match_removed_ && current_match_ >= 0)
   {
-    const MatchDataPtr match = *current_match_;
-
-    // Get the start of the match.
-    const iterator start = match->mark->get_iter();
+    iterator            start;
+    iterator            stop;
+    Glib::ustring       subject;
+    Util::CaptureVector captures;
 
-    // Find the end of the match.
-    iterator stop = start;
-    stop.forward_chars(match->length);
+    get_match_subject(current_match_, start, stop, subject, captures);
 
     // Find begin and end of the line containing the match.
     iterator line_begin = start;
@@ -492,7 +603,7 @@ int FileBuffer::get_line_preview(const Glib::ustring& substitution, Glib::ustrin
 
     // Construct the preview line: [line_begin,start) + substitution + [stop,line_end)
     result   = get_text(line_begin, start);
-    result  += Util::substitute_references(substitution, match->subject, match->captures);
+    result  += Util::substitute_references(substitution, subject, captures);
     position = result.length();
     result  += get_text(stop, line_end);
   }
@@ -501,6 +612,31 @@ int FileBuffer::get_line_preview(const Glib::ustring& substitution, Glib::ustrin
   return position;
 }
 
+void FileBuffer::set_highlight_range(const FileBuffer::iterator& range_begin,
+                                     const FileBuffer::iterator& range_end)
+{
+  if (highlight_begin_)
+  {
+    const iterator old_begin = highlight_begin_->get_iter();
+    const iterator old_end   = highlight_end_->get_iter();
+
+    if (old_begin == range_begin && old_end == range_end)
+      return;
+
+    remove_tag(RegexxerTags::instance()->match, old_begin, old_end);
+
+    move_mark(highlight_begin_, range_begin);
+    move_mark(highlight_end_,   range_end);
+  }
+  else
+  {
+    highlight_begin_ = create_mark(range_begin, true); // left gravity
+    highlight_end_   = create_mark(range_end,  false); // right gravity
+  }
+
+  apply_tag_highlight_range();
+}
+
 void FileBuffer::increment_stamp()
 {
   ++stamp_modified_;
@@ -518,53 +654,73 @@ void FileBuffer::decrement_stamp()
   set_modified(stamp_modified_ != stamp_saved_);
 }
 
-void FileBuffer::undo_remove_match(const MatchDataPtr& match, int offset)
+void FileBuffer::undo_remove_match(int slot, int offset)
 {
-  const std::pair<MatchSet::iterator, bool> pos = match_set_.insert(match);
-  g_return_if_fail(pos.second);
+  g_return_if_fail(!matches_.is_live(slot));
 
-  const iterator start = get_iter_at_offset(offset);
-  match->install_mark(start);
+  matches_.revive(slot, offset);
 
-  if (match->length > 0)
-  {
-    const Glib::RefPtr<RegexxerTags> tagtable = RegexxerTags::instance();
+  if (highlight_begin_)
+    apply_tag_match(slot, highlight_begin_->get_iter(), highlight_end_->get_iter());
 
-    iterator stop = start;
-    stop.forward_chars(match->length);
+  if (match_removed_ && matches_.next_live(slot) == current_match_)
+  {
+    current_match_ = slot;
+    match_removed_ = false;
 
-    apply_tag(tagtable->match, start, stop);
+    apply_tag_current();
   }
 
-  if (match_removed_ && Util::next(pos.first) == current_match_)
+  signal_preview_line_changed.queue();
+
+  signal_match_count_changed(); // emit
+  update_bound_state();
+}
+
+void FileBuffer::undo_replace_all(const Glib::ustring& text, const MatchSlotList& removed)
+{
+  replace_text(text);
+
+  for (MatchSlotList::const_iterator p = removed.begin(); p != removed.end(); ++p)
+    matches_.revive(p->first, p->second);
+
+  apply_tag_highlight_range();
+
+  // Just like undo_remove_match(), make the match before the position
+  // of the removed current match the current one again.
+  if (match_removed_)
   {
-    current_match_ = pos.first;
-    match_removed_ = false;
+    const int slot = (current_match_ >= 0) ? matches_.prev_live(current_match_)
+                                           : matches_.last_live();
+    if (slot >= 0)
+    {
+      current_match_ = slot;
+      match_removed_ = false;
 
-    apply_tag_current();
+      apply_tag_current();
+    }
   }
 
   signal_preview_line_changed.queue();
 
-  ++match_count_;
   signal_match_count_changed(); // emit
   update_bound_state();
 }
 
 /*
  * Unfortunately it turned out to be necessary to keep track of UndoActions
- * that reference MatchData objects, since find_matches() needs some way of
+ * that reference match slots, since find_matches() needs some way of
  * telling the UndoAction objects to drop their references.  Omitting this
  * causes clashes between new matches and the obsolete ones which are still
  * assumed to be valid by the undo actions.  (In short: if it doesn't crash,
  * it's still going to leak out memory like the Titanic leaked in water.)
  */
-void FileBuffer::undo_add_weak(FileBufferActionRemoveMatch* ptr)
+void FileBuffer::undo_add_weak(FileBufferMatchAction* ptr)
 {
   weak_undo_stack_.push(ptr);
 }
 
-void FileBuffer::undo_remove_weak(FileBufferActionRemoveMatch* ptr)
+void FileBuffer::undo_remove_weak(FileBufferMatchAction* ptr)
 {
   // Thanks to the strict LIFO semantics of UndoStack it's possible
   // to implement the weak references as stack too, thus reducing the
@@ -577,14 +733,19 @@ void FileBuffer::undo_remove_weak(FileBufferActionRemoveMatch* ptr)
 
 void FileBuffer::on_insert(const FileBuffer::iterator& pos, const Glib::ustring& text, int bytes)
 {
+  ++stamp_changed_;
+
+  const int offset = pos.get_offset();
+  int       length = 0;
+
   if (!text.empty())
   {
-    if (!match_removed_ && current_match_ != match_set_.end())
+    if (!match_removed_ && current_match_ >= 0)
     {
       // Test whether pos is within the current match and push
       // signal_preview_line_changed() on the queue if true.
 
-      iterator lbegin = (*current_match_)->mark->get_iter();
+      iterator lbegin = current_mark_->get_iter();
       iterator lend   = lbegin;
       find_line_bounds(lbegin, lend);
 
@@ -592,34 +753,40 @@ void FileBuffer::on_insert(const FileBuffer::iterator& pos, const Glib::ustring&
         signal_preview_line_changed.queue();
     }
 
-    const Glib::RefPtr<RegexxerTags> tagtable = RegexxerTags::instance();
-
     // If pos is within a match then remove this match.
-    if (pos.has_tag(tagtable->match) && !is_match_start(pos))
-    {
-      iterator start = pos;
-      start.backward_to_tag_toggle(tagtable->match);
-      remove_match_at_iter(start);
-    }
+    const int slot = matches_.find_enclosing(offset);
+
+    if (slot >= 0)
+      remove_match(slot);
+
+    length = text.length();
   }
 
   if (user_action_stack_)
   {
     user_action_stack_->push(UndoActionPtr(
-        new FileBufferActionInsert(*this, pos.get_offset(), text)));
+        new FileBufferActionInsert(*this, offset, text)));
   }
 
   Gtk::TextBuffer::on_insert(pos, text, bytes);
+
+  if (length > 0)
+  {
+    matches_.adjust_insert(offset, length);
+    dirty_ranges_.adjust_insert(offset, length);
+  }
 }
 
 void FileBuffer::on_erase(const FileBuffer::iterator& rbegin, const FileBuffer::iterator& rend)
 {
-  if (!match_removed_ && current_match_ != match_set_.end())
+  ++stamp_changed_;
+
+  if (!match_removed_ && current_match_ >= 0)
   {
     // Test whether [rbegin,rend) overlaps with the current match
     // and push signal_preview_line_changed() on the queue if true.
 
-    iterator lbegin = (*current_match_)->mark->get_iter();
+    iterator lbegin = current_mark_->get_iter();
     iterator lend   = lbegin;
     find_line_bounds(lbegin, lend);
 
@@ -627,83 +794,34 @@ void FileBuffer::on_erase(const FileBuffer::iterator& rbegin, const FileBuffer::
       signal_preview_line_changed.queue();
   }
 
-  const Glib::RefPtr<const Gtk::TextTag> tag_match = RegexxerTags::instance()->match;
-
-  if (!rbegin.starts_line() && rbegin.has_tag(tag_match))
-  {
-    g_return_if_fail(!rbegin.ends_tag(tag_match)); // just to be sure...
-
-    int backward_chars = 0;
-    int match_length = -1;
-    iterator pos = rbegin;
+  const int begin_offset = rbegin.get_offset();
+  const int end_offset   = rend.get_offset();
 
-    do
-    {
-      ++backward_chars;
-      --pos;
+  // Remove the match that starts before the range but reaches into it,
+  // which might be in an earlier line, and all the matches starting within.
+  const int enclosing = matches_.find_enclosing(begin_offset);
 
-      typedef std::vector< Glib::RefPtr<Mark> > MarkList;
-      const MarkList marks (const_cast<iterator&>(pos).get_marks());  // XXX
+  if (enclosing >= 0)
+    remove_match(enclosing);
 
-      for (MarkList::const_iterator pmark = marks.begin(); pmark != marks.end(); ++pmark)
-      {
-        if (const MatchDataPtr match_data = MatchData::get_from_mark(*pmark))
-          match_length = std::max(match_length, match_data->length);
-      }
-    }
-    while (match_length < 0 && !pos.starts_line() && !pos.toggles_tag(tag_match));
-
-    if (match_length > backward_chars)
-      remove_match_at_iter(pos);
+  for (int slot = matches_.find_first_at(begin_offset);
+       slot < matches_.get_slot_count() && matches_.get_offset(slot) < end_offset;
+       ++slot)
+  {
+    if (matches_.is_live(slot))
+      remove_match(slot);
   }
 
-  for (iterator pos = rbegin; pos != rend; ++pos)
-    remove_match_at_iter(pos);
-
   if (user_action_stack_)
   {
     user_action_stack_->push(UndoActionPtr(
-        new FileBufferActionErase(*this, rbegin.get_offset(), get_slice(rbegin, rend))));
+        new FileBufferActionErase(*this, begin_offset, get_slice(rbegin, rend))));
   }
 
   Gtk::TextBuffer::on_erase(rbegin, rend);
-}
-
-void FileBuffer::on_mark_deleted(const Glib::RefPtr<FileBuffer::Mark>& mark)
-{
-  Gtk::TextBuffer::on_mark_deleted(mark);
-
-  // If a mark has been deleted we check whether it was one of our match
-  // marks and if so, remove it from the list.  Deletion of the current
-  // match has to be special cased, but's also a bit faster this way since
-  // it's the most common situation and we don't need to traverse the list.
-
-  if (current_match_ != match_set_.end() && (*current_match_)->mark == mark)
-  {
-    const MatchSet::iterator pos = current_match_++;
-
-    Glib::RefPtr<FileBuffer::Mark>().swap((*pos)->mark);
-    match_set_.erase(pos);
-    match_removed_ = true;
-
-    --match_count_;
-    signal_match_count_changed(); // emit
-    update_bound_state();
-  }
-  else if (const MatchDataPtr match_data = MatchData::get_from_mark(mark))
-  {
-    const MatchSet::iterator pos = match_set_.find(match_data);
 
-    if (pos != match_set_.end())
-    {
-      Glib::RefPtr<FileBuffer::Mark>().swap((*pos)->mark);
-      match_set_.erase(pos);
-
-      --match_count_;
-      signal_match_count_changed(); // emit
-      update_bound_state();
-    }
-  }
+  matches_.adjust_erase(begin_offset, end_offset);
+  dirty_ranges_.adjust_erase(begin_offset, end_offset);
 }
 
 void FileBuffer::on_apply_tag(const Glib::RefPtr<FileBuffer::Tag>& tag,
@@ -744,80 +862,306 @@ void FileBuffer::on_end_user_action()
 
 /**** Regexxer::FileBuffer -- private **************************************/
 
-void FileBuffer::replace_match(MatchSet::const_iterator pos, const Glib::ustring& substitution)
+/*
+ * Bring the matches of the last search up to date by running its pattern
+ * over the lines that changed since.  The matches in all other lines are
+ * taken over as they are, which is exactly what a full search would find,
+ * since the pattern is never multiline.
+ */
+int FileBuffer::rescan_matches()
 {
-  const MatchDataPtr match = *pos;
+  ScopedLock  lock  (*this);
+  ScopedTimer timer (STATS_MATCH);
 
-  const Glib::ustring substituted_text =
-      Util::substitute_references(substitution, match->subject, match->captures);
+  if (dirty_ranges_.empty())
+    return matches_.get_live_count();
+
+  typedef DirtyRangeList::RangeVector::const_iterator RangeIterator;
+
+  const std::string   text = get_text().raw();
+  const RangeIterator pend = dirty_ranges_.get_ranges().end();
+
+  MatchTable  rescanned;
+  int         slot       = matches_.first_live();
+  int         last_end   = 0; // end of the last match in the new table
+  int         range_stop = 0; // end of the last range scanned
+  int         char_pos   = 0; // the same position in text, in characters
+  const char* byte_pos   = text.data(); // and as pointer
+
+  for (RangeIterator prange = dirty_ranges_.get_ranges().begin(); prange != pend;)
+  {
+    iterator range_begin = get_iter_at_offset(prange->first);
+    range_begin.set_line_offset(0);
+
+    // Never go back into the lines scanned already.
+    if (range_begin.get_offset() < range_stop)
+      range_begin = get_iter_at_offset(range_stop);
+
+    iterator range_end = get_iter_at_offset(prange->second);
+    range_end.forward_line();
+
+    // Merge the following ranges that start within the lines covered.
+    while (++prange != pend && prange->first <= range_end.get_offset())
+    {
+      range_end = get_iter_at_offset(prange->second);
+      range_end.forward_line();
+    }
+
+    const int begin_offset = range_begin.get_offset();
+    const int end_offset   = range_end.get_offset();
+
+    // Take over the matches before the range, and drop those within.
+    for (; slot >= 0 && matches_.get_offset(slot) < end_offset; slot = matches_.next_live(slot))
+    {
+      const int offset = matches_.get_offset(slot);
+
+      if (offset < begin_offset && offset >= last_end)
+      {
+        rescanned.append_from(matches_, slot);
+        last_end = offset + matches_.get_length(slot);
+      }
+    }
+
+    // The ranges are sorted, so the byte positions can be found by moving
+    // forward through the text.
+    byte_pos = g_utf8_offset_to_pointer(byte_pos, begin_offset - char_pos);
+    const std::size_t begin_index = byte_pos - text.data();
+
+    byte_pos = g_utf8_offset_to_pointer(byte_pos, end_offset - begin_offset);
+    const std::size_t end_index = byte_pos - text.data();
+
+    char_pos   = end_offset;
+    range_stop = end_offset;
+
+    ScanMatchList found;
+    Stats::add_matches(scan_text_lines(scan_pattern_, scan_multiple_, text, range_begin.get_line(),
+                                       begin_index, end_index, found));
+    Stats::add_bytes(STATS_MATCH, end_index - begin_index);
+
+    for (ScanMatchList::const_iterator pmatch = found.begin(); pmatch != found.end(); ++pmatch)
+    {
+      const std::pair<int, int> bounds = pmatch->captures.front();
+      const char *const         line   = text.data() + pmatch->line_begin;
+
+      const int offset = get_iter_at_line_index(pmatch->line, bounds.first).get_offset();
+      const int length = g_utf8_strlen(line + bounds.first, bounds.second - bounds.first);
 
-  // Get the start of the match.
-  const iterator start = match->mark->get_iter();
+      if (offset >= last_end)
+      {
+        rescanned.append(offset, length, pmatch->captures);
+        last_end = offset + length;
+      }
+    }
+  }
 
-  if (match->length > 0)
+  // Take over the matches after the last range.
+  for (; slot >= 0; slot = matches_.next_live(slot))
   {
-    // Find end of match.
-    iterator stop = start;
-    stop.forward_chars(match->length);
+    if (matches_.get_offset(slot) >= last_end)
+      rescanned.append_from(matches_, slot);
+  }
+
+  remove_all_matches();
+  matches_.swap(rescanned);
+  dirty_ranges_.clear();
+
+  apply_tag_highlight_range();
+
+  signal_match_count_changed(); // emit
+  return matches_.get_live_count();
+}
+
+void FileBuffer::remove_all_matches()
+{
+  notify_weak_undos();
+  forget_current_match();
 
+  // The match tag never extends beyond the highlight range.
+  if (highlight_begin_)
+    remove_tag(RegexxerTags::instance()->match,
+               highlight_begin_->get_iter(), highlight_end_->get_iter());
+
+  matches_.clear();
+  update_bound_state();
+}
+
+void FileBuffer::replace_match(int slot, const Glib::ustring& substitution)
+{
+  iterator            start;
+  iterator            stop;
+  Glib::ustring       subject;
+  Util::CaptureVector captures;
+
+  get_match_subject(slot, start, stop, subject, captures);
+
+  const Glib::ustring substituted_text =
+      Util::substitute_references(substitution, subject, captures);
+
+  if (matches_.get_length(slot) > 0)
+  {
     // Replace match with new substituted text.
     insert(erase(start, stop), substituted_text); // triggers on_erase() and on_insert()
   }
   else // empty match
   {
-    if (user_action_stack_)
-    {
-      user_action_stack_->push(UndoActionPtr(
-          new FileBufferActionRemoveMatch(*this, start.get_offset(), match)));
-    }
+    const int offset = start.get_offset();
 
-    // Manually remove match mark and insert the new text.
-    delete_mark(match->mark); // triggers on_mark_deleted()
+    // Manually remove the match and insert the new text.
+    remove_match(slot);
+
+    const iterator pos = get_iter_at_offset(offset);
 
     if (!substituted_text.empty())
-      insert(start, substituted_text); // triggers on_insert()
+      insert(pos, substituted_text); // triggers on_insert()
     else
       // Do a dummy insert to avoid special case of empty-by-empty replace.
-      on_insert(start, substituted_text, 0);
+      on_insert(pos, substituted_text, 0);
   }
 }
 
 /*
- * Remove the match at position start.  The removal includes the match's
- * Mark object and the tags applied to it.
+ * Replace the whole text of the buffer, keeping the cursor and the
+ * highlight range at the same offsets as far as possible.
  */
-void FileBuffer::remove_match_at_iter(const FileBuffer::iterator& start)
+void FileBuffer::replace_text(const Glib::ustring& text)
 {
-  typedef std::vector< Glib::RefPtr<Mark> > MarkList;
-  const MarkList marks (const_cast<iterator&>(start).get_marks()); // XXX
+  const int cursor_offset = get_insert()->get_iter().get_offset();
+  int       range_begin   = 0;
+  int       range_end     = 0;
 
-  for (MarkList::const_iterator pmark = marks.begin(); pmark != marks.end(); ++pmark)
+  if (highlight_begin_)
   {
-    const MatchDataPtr match = MatchData::get_from_mark(*pmark);
+    range_begin = highlight_begin_->get_iter().get_offset();
+    range_end   = highlight_end_  ->get_iter().get_offset();
+  }
 
-    if (!match)
-      continue; // not a match mark
+  insert(erase(begin(), end()), text); // triggers on_erase() and on_insert()
 
-    if (user_action_stack_)
-    {
-      user_action_stack_->push(UndoActionPtr(
-          new FileBufferActionRemoveMatch(*this, start.get_offset(), match)));
-    }
+  // get_iter_at_offset() clamps the offset to the end of the buffer.
+  place_cursor(get_iter_at_offset(cursor_offset));
 
-    if (match->length > 0)
-    {
-      const Glib::RefPtr<RegexxerTags> tagtable = RegexxerTags::instance();
+  if (highlight_begin_)
+  {
+    move_mark(highlight_begin_, get_iter_at_offset(range_begin));
+    move_mark(highlight_end_,   get_iter_at_offset(range_end));
+  }
+}
 
-      iterator stop = start;
-      stop.forward_chars(match->length);
+/*
+ * Remove the match in the given slot, including the tags applied to it.
+ * If it is the current match, the next match takes its place, but without
+ * being highlighted.
+ */
+void FileBuffer::remove_match(int slot)
+{
+  const int offset = matches_.get_offset(slot);
+  const int length = matches_.get_length(slot);
+
+  if (user_action_stack_)
+  {
+    user_action_stack_->push(UndoActionPtr(
+        new FileBufferActionRemoveMatch(*this, offset, slot)));
+  }
 
-      remove_tag(tagtable->match, start, stop);
+  if (length > 0)
+  {
+    const Glib::RefPtr<RegexxerTags> tagtable = RegexxerTags::instance();
 
-      if (start.begins_tag(tagtable->current))
-        remove_tag(tagtable->current, start, stop);
-    }
+    const iterator start = get_iter_at_offset(offset);
+    iterator       stop  = start;
+    stop.forward_chars(length);
+
+    remove_tag(tagtable->match, start, stop);
+
+    if (start.begins_tag(tagtable->current))
+      remove_tag(tagtable->current, start, stop);
+  }
+  else if (slot == current_match_ && !match_removed_)
+  {
+    current_mark_->set_visible(false);
+  }
+
+  matches_.remove(slot);
+
+  if (slot == current_match_)
+  {
+    current_match_ = matches_.next_live(slot);
+    match_removed_ = true;
+  }
+
+  signal_match_count_changed(); // emit
+  update_bound_state();
+}
+
+/*
+ * Retrieve the bounds of a match together with its subject, i.e. the line
+ * or lines it spans, and the captures relative to the subject.
+ */
+void FileBuffer::get_match_subject(int slot, FileBuffer::iterator& start,
+                                   FileBuffer::iterator& stop, Glib::ustring& subject,
+                                   Util::CaptureVector& captures)
+{
+  start = get_iter_at_offset(matches_.get_offset(slot));
+  stop  = start;
+  stop.forward_chars(matches_.get_length(slot));
+
+  iterator line_begin = start;
+  iterator line_end   = stop;
+  find_line_bounds(line_begin, line_end);
+
+  subject = get_text(line_begin, line_end);
+
+  matches_.get_captures(slot, start.get_line_index(), subject.raw(), captures);
+}
+
+/*
+ * Highlight the part of a match that lies within [range_begin,range_end).
+ * Clipping the tag guarantees that the highlighting can be removed again
+ * by looking at the range only.
+ */
+void FileBuffer::apply_tag_match(int slot, const FileBuffer::iterator& range_begin,
+                                 const FileBuffer::iterator& range_end)
+{
+  const int length = matches_.get_length(slot);
+
+  if (length > 0)
+  {
+    iterator start = get_iter_at_offset(matches_.get_offset(slot));
+    iterator stop  = start;
+    stop.forward_chars(length);
+
+    if (start < range_begin)
+      start = range_begin;
 
-    delete_mark(*pmark); // triggers on_mark_deleted()
+    if (range_end < stop)
+      stop = range_end;
+
+    if (start < stop)
+      apply_tag(RegexxerTags::instance()->match, start, stop);
+  }
+}
+
+void FileBuffer::apply_tag_highlight_range()
+{
+  if (!highlight_begin_)
+    return;
+
+  const iterator range_begin  = highlight_begin_->get_iter();
+  const iterator range_end    = highlight_end_->get_iter();
+  const int      begin_offset = range_begin.get_offset();
+  const int      end_offset   = range_end.get_offset();
+
+  const int enclosing = matches_.find_enclosing(begin_offset);
+
+  if (enclosing >= 0)
+    apply_tag_match(enclosing, range_begin, range_end);
+
+  for (int slot = matches_.find_first_at(begin_offset);
+       slot < matches_.get_slot_count() && matches_.get_offset(slot) < end_offset;
+       ++slot)
+  {
+    if (matches_.is_live(slot))
+      apply_tag_match(slot, range_begin, range_end);
   }
 }
 
@@ -827,13 +1171,13 @@ void FileBuffer::remove_tag_current()
   // to the next match but it doesn't have the "current-match" tag set.  So we
   // skip removal of the "current-match" tag since it doesn't exist anymore.
 
-  if (!match_removed_ && current_match_ != match_set_.end())
+  if (!match_removed_ && current_match_ >= 0)
   {
     const Glib::RefPtr<RegexxerTags> tagtable = RegexxerTags::instance();
 
     // Get the start position of the current match.
-    const iterator start   = (*current_match_)->mark->get_iter();
-    const int match_length = (*current_match_)->length;
+    const iterator start   = current_mark_->get_iter();
+    const int match_length = matches_.get_length(current_match_);
 
     if (match_length > 0)
     {
@@ -845,7 +1189,7 @@ void FileBuffer::remove_tag_current()
     }
     else // empty match
     {
-      (*current_match_)->mark->set_visible(false);
+      current_mark_->set_visible(false);
     }
 
     signal_preview_line_changed.queue();
@@ -854,13 +1198,19 @@ void FileBuffer::remove_tag_current()
 
 void FileBuffer::apply_tag_current()
 {
-  if (!match_removed_ && current_match_ != match_set_.end())
+  if (!match_removed_ && current_match_ >= 0)
   {
     const Glib::RefPtr<RegexxerTags> tagtable = RegexxerTags::instance();
 
     // Get the start position of the match.
-    const iterator start   = (*current_match_)->mark->get_iter();
-    const int match_length = (*current_match_)->length;
+    const iterator start   = get_iter_at_offset(matches_.get_offset(current_match_));
+    const int match_length = matches_.get_length(current_match_);
+
+    // Only the current match gets a mark, which is reused for every match.
+    if (current_mark_)
+      move_mark(current_mark_, start);
+    else
+      current_mark_ = create_mark(start, false); // right gravity
 
     if (match_length > 0)
     {
@@ -872,7 +1222,7 @@ void FileBuffer::apply_tag_current()
     }
     else // empty match
     {
-      (*current_match_)->mark->set_visible(true);
+      current_mark_->set_visible(true);
     }
 
     place_cursor(start);
@@ -881,15 +1231,6 @@ void FileBuffer::apply_tag_current()
   }
 }
 
-// static
-bool FileBuffer::is_match_start(const iterator& where)
-{
-  typedef std::vector< Glib::RefPtr<Mark> > MarkList;
-  const MarkList marks (const_cast<iterator&>(where).get_marks()); // XXX
-
-  return (std::find_if(marks.begin(), marks.end(), &MatchData::is_match_mark) != marks.end());
-}
-
 // static
 void FileBuffer::find_line_bounds(FileBuffer::iterator& line_begin, FileBuffer::iterator& line_end)
 {
@@ -911,7 +1252,7 @@ void FileBuffer::notify_weak_undos()
 {
   while (!weak_undo_stack_.empty())
   {
-    FileBufferActionRemoveMatch *const ptr = weak_undo_stack_.top();
+    FileBufferMatchAction *const ptr = weak_undo_stack_.top();
     weak_undo_stack_.pop();
     ptr->weak_notify();
   }
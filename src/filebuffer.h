@@ -23,17 +23,18 @@
 
 #include "fileshared.h"
 #include "signalutils.h"
+#include "textscan.h"
 #include "undostack.h"
 
 #include <gtksourceviewmm/buffer.h>
-#include <set>
 #include <stack>
 
 
 namespace Regexxer
 {
 
-class FileBufferActionRemoveMatch;
+class FileBufferMatchAction;
+class ProgressReporter;
 
 
 class FileBuffer : public Gsv::Buffer
@@ -50,8 +51,25 @@ public:
   bool is_freeable() const;
   bool in_user_action() const;
 
+  // The lengthy operations below can be cancelled through the progress
+  // reporter, which is also polled regularly to keep the GUI responsive.
+
   int find_matches(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
-                   const sigc::slot<void, int, const Glib::ustring&>& feedback);
+                   const sigc::slot<void, int, const Glib::ustring&>& feedback,
+                   ProgressReporter* progress = 0);
+
+  int install_matches(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                      const std::string& text, const ScanMatchList& matches,
+                      const sigc::slot<void, int, const Glib::ustring&>& feedback,
+                      ProgressReporter* progress = 0);
+
+  // Whether find_matches() can bring the matches up to date by scanning
+  // just the lines that changed since the last search, which has to have
+  // been done with the same pattern.
+  bool can_rescan(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple) const;
+
+  // Incremented on every change of the buffer text.
+  unsigned long get_change_stamp() const;
 
   int get_match_count() const;
   int get_match_index() const;
@@ -63,21 +81,25 @@ public:
   BoundState get_bound_state();
 
   void replace_current_match(const Glib::ustring& substitution);
-  void replace_all_matches(const Glib::ustring& substitution);
+  void replace_all_matches(const Glib::ustring& substitution, ProgressReporter* progress = 0);
 
   int get_line_preview(const Glib::ustring& substitution, Glib::ustring& preview);
 
+  // Only the matches within this range are highlighted, which should
+  // cover the part of the buffer that is currently visible.
+  void set_highlight_range(const iterator& range_begin, const iterator& range_end);
+
   // Special API for the FileBufferAction classes.
   void increment_stamp();
   void decrement_stamp();
-  void undo_remove_match(const MatchDataPtr& match, int offset);
-  void undo_add_weak(FileBufferActionRemoveMatch* ptr);
-  void undo_remove_weak(FileBufferActionRemoveMatch* ptr);
+  void undo_remove_match(int slot, int offset);
+  void undo_replace_all(const Glib::ustring& text, const MatchSlotList& removed);
+  void undo_add_weak(FileBufferMatchAction* ptr);
+  void undo_remove_weak(FileBufferMatchAction* ptr);
 
   sigc::signal<void>                signal_match_count_changed;
   sigc::signal<void>                signal_bound_state_changed;
   Util::QueuedSignal                signal_preview_line_changed;
-  sigc::signal<bool>                signal_pulse;
   sigc::signal<void, UndoActionPtr> signal_undo_stack_push;
 
 protected:
@@ -85,7 +107,6 @@ protected:
 
   virtual void on_insert(const iterator& pos, const Glib::ustring& text, int bytes);
   virtual void on_erase(const iterator& rbegin, const iterator& rend);
-  virtual void on_mark_deleted(const Glib::RefPtr<Mark>& mark);
   virtual void on_apply_tag(const Glib::RefPtr<Tag>& tag,
                             const iterator& range_begin, const iterator& range_end);
   virtual void on_modified_changed();
@@ -96,28 +117,39 @@ private:
   class ScopedLock;
   class ScopedUserAction;
 
-  typedef std::set<MatchDataPtr, MatchDataLess>     MatchSet;
-  typedef std::stack<FileBufferActionRemoveMatch*>  WeakUndoStack;
+  typedef std::stack<FileBufferMatchAction*>  WeakUndoStack;
 
-  MatchSet            match_set_;
-  MatchSet::iterator  current_match_;
+  MatchTable          matches_;
+  int                 current_match_;
+  Glib::RefPtr<Mark>  current_mark_;
+  Glib::RefPtr<Mark>  highlight_begin_;
+  Glib::RefPtr<Mark>  highlight_end_;
+  DirtyRangeList      dirty_ranges_;
+  Glib::RefPtr<Glib::Regex> scan_pattern_;
+  bool                scan_multiple_;
   UndoStackPtr        user_action_stack_;
   WeakUndoStack       weak_undo_stack_;
-  int                 match_count_;
-  int                 original_match_count_;
   unsigned long       stamp_modified_;
   unsigned long       stamp_saved_;
+  unsigned long       stamp_changed_;
   BoundState          cached_bound_state_;
   bool                match_removed_;
   bool                locked_;
 
-  void replace_match(MatchSet::const_iterator pos, const Glib::ustring& substitution);
-  void remove_match_at_iter(const iterator& start);
+  int  rescan_matches();
+  void remove_all_matches();
+  void replace_match(int slot, const Glib::ustring& substitution);
+  void remove_match(int slot);
+  void replace_text(const Glib::ustring& text);
+  void get_match_subject(int slot, iterator& start, iterator& stop,
+                         Glib::ustring& subject, Util::CaptureVector& captures);
+
+  void apply_tag_match(int slot, const iterator& range_begin, const iterator& range_end);
+  void apply_tag_highlight_range();
 
   void remove_tag_current();
   void apply_tag_current();
 
-  static bool is_match_start(const iterator& where);
   static void find_line_bounds(iterator& line_begin, iterator& line_end);
 
   void update_bound_state();
@@ -93,36 +93,74 @@ bool FileBufferActionErase::do_undo(const sigc::slot<bool>&)
 /**** Regexxer::FileBufferActionRemoveMatch ********************************/
 
 FileBufferActionRemoveMatch::FileBufferActionRemoveMatch(
-    FileBuffer& filebuffer, int offset, const MatchDataPtr& match)
+    FileBuffer& filebuffer, int offset, int slot)
 :
-  FileBufferAction(filebuffer),
-  match_          (match),
-  offset_         (offset)
+  FileBufferMatchAction(filebuffer),
+  slot_                (slot),
+  offset_              (offset)
 {
-  if (match_)
+  if (slot_ >= 0)
     buffer().undo_add_weak(this);
 }
 
 FileBufferActionRemoveMatch::~FileBufferActionRemoveMatch()
 {
-  if (match_)
+  if (slot_ >= 0)
     buffer().undo_remove_weak(this);
 }
 
 void FileBufferActionRemoveMatch::weak_notify()
 {
-  match_.reset();
+  slot_ = -1;
 }
 
 bool FileBufferActionRemoveMatch::do_undo(const sigc::slot<bool>&)
 {
-  if (match_)
+  if (slot_ >= 0)
   {
     g_return_val_if_fail(!buffer().in_user_action(), true);
 
-    buffer().undo_remove_match(match_, offset_);
+    buffer().undo_remove_match(slot_, offset_);
   }
   return true;
 }
 
+
+/**** Regexxer::FileBufferActionReplaceAll *********************************/
+
+FileBufferActionReplaceAll::FileBufferActionReplaceAll(
+    FileBuffer& filebuffer, const Glib::ustring& text, const MatchSlotList& removed)
+:
+  FileBufferMatchAction(filebuffer),
+  text_                (text),
+  removed_             (removed),
+  weak_                (true)
+{
+  buffer().increment_stamp();
+  buffer().undo_add_weak(this);
+}
+
+FileBufferActionReplaceAll::~FileBufferActionReplaceAll()
+{
+  if (weak_)
+    buffer().undo_remove_weak(this);
+}
+
+void FileBufferActionReplaceAll::weak_notify()
+{
+  // The text can still be restored, just without the matches.
+  MatchSlotList().swap(removed_);
+  weak_ = false;
+}
+
+bool FileBufferActionReplaceAll::do_undo(const sigc::slot<bool>&)
+{
+  g_return_val_if_fail(!buffer().in_user_action(), false);
+
+  buffer().undo_replace_all(text_, removed_);
+  buffer().decrement_stamp();
+
+  return false;
+}
+
 } // namespace Regexxer
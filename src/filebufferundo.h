@@ -68,21 +68,57 @@ private:
   virtual bool do_undo(const sigc::slot<bool>& pulse);
 };
 
-class FileBufferActionRemoveMatch : public FileBufferAction
+/*
+ * Base class of the actions that refer to match slots.  These become
+ * invalid as soon as the buffer is searched again, which the buffer
+ * announces by calling weak_notify().
+ */
+class FileBufferMatchAction : public FileBufferAction
+{
+public:
+  virtual void weak_notify() = 0;
+
+protected:
+  explicit FileBufferMatchAction(FileBuffer& filebuffer)
+    : FileBufferAction(filebuffer) {}
+};
+
+class FileBufferActionRemoveMatch : public FileBufferMatchAction
 {
 public:
-  FileBufferActionRemoveMatch(FileBuffer& filebuffer, int offset, const MatchDataPtr& match);
+  FileBufferActionRemoveMatch(FileBuffer& filebuffer, int offset, int slot);
   virtual ~FileBufferActionRemoveMatch();
 
-  void weak_notify();
+  virtual void weak_notify();
 
 private:
-  MatchDataPtr  match_;
+  int           slot_;
   int           offset_;
 
   virtual bool do_undo(const sigc::slot<bool>& pulse);
 };
 
+/*
+ * Undo a FileBuffer::replace_all_matches() in one step, by restoring the
+ * previous text as a whole and reviving the matches.
+ */
+class FileBufferActionReplaceAll : public FileBufferMatchAction
+{
+public:
+  FileBufferActionReplaceAll(FileBuffer& filebuffer, const Glib::ustring& text,
+                             const MatchSlotList& removed);
+  virtual ~FileBufferActionReplaceAll();
+
+  virtual void weak_notify();
+
+private:
+  Glib::ustring text_;
+  MatchSlotList removed_;
+  bool          weak_;
+
+  virtual bool do_undo(const sigc::slot<bool>& pulse);
+};
+
 } // namespace Regexxer
 
 #endif /* REGEXXER_FILEBUFFERUNDO_H_INCLUDED */
@@ -21,12 +21,22 @@
 #include "fileio.h"
 #include "filebuffer.h"
 #include "miscutils.h"
+#include "stats.h"
 #include "stringutils.h"
+#include "textscan.h"
+#include "translation.h"
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <glibmm.h>
 #include <giomm.h>
 #include <gtksourceviewmm.h> 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 
 namespace
@@ -36,6 +46,87 @@ using Regexxer::FileBuffer;
 
 enum { BUFSIZE = 4096 };
 
+// The buffer size for streaming output into a file.
+enum { WRITE_BUFSIZE = 64 * 1024 };
+
+// The amount of text, in characters, that the content type is guessed from.
+enum { CONTENT_SAMPLE_SIZE = 4096 };
+
+class ScopedMappedFile
+{
+private:
+  GMappedFile* mapped_;
+
+  ScopedMappedFile(const ScopedMappedFile&);
+  ScopedMappedFile& operator=(const ScopedMappedFile&);
+
+public:
+  explicit ScopedMappedFile(const std::string& filename);
+  ~ScopedMappedFile() { g_mapped_file_unref(mapped_); }
+
+  const char* data() const { return g_mapped_file_get_contents(mapped_); }
+  gsize       size() const { return g_mapped_file_get_length(mapped_); }
+};
+
+ScopedMappedFile::ScopedMappedFile(const std::string& filename)
+:
+  mapped_ (0)
+{
+  GError* error = 0;
+  mapped_ = g_mapped_file_new(filename.c_str(), FALSE, &error);
+
+  if (G_UNLIKELY(error))
+    Glib::Error::throw_exception(error);
+}
+
+/*
+ * The regex engine takes byte offsets of type gint, so refuse to scan
+ * texts that are too large for them, rather than miss some matches.
+ */
+static
+void check_text_size(const std::string& filename, gsize size)
+{
+  if (G_UNLIKELY(!Regexxer::is_scannable_size(size)))
+    throw Glib::FileError(Glib::FileError::FAILED,
+                          Util::compose(_("The file \342\200\234%1\342\200\235 is too large to be searched."),
+                                        Glib::filename_display_name(filename)));
+}
+
+/*
+ * Map the file into memory, and if it turns out to be valid UTF-8, copy
+ * it into a new buffer in one go.  Binary detection and validation are
+ * done in a single pass, since g_utf8_validate() stops at a nul byte.
+ * Returns a null pointer if the file has to be converted.
+ */
+static
+Glib::RefPtr<FileBuffer> load_mapped_utf8(const std::string& filename)
+{
+  const ScopedMappedFile mapped (filename);
+
+  const char* const data = mapped.data();
+  const gsize       size = mapped.size();
+  const char*       invalid = 0;
+
+  if (size > 0 && !g_utf8_validate(data, size, &invalid))
+  {
+    if (*invalid == '\0') // binary file?
+      throw Regexxer::ErrorBinaryFile();
+
+    return Glib::RefPtr<FileBuffer>();
+  }
+
+  const Glib::RefPtr<FileBuffer> text_buffer = FileBuffer::create();
+
+  if (size > 0)
+  {
+    text_buffer->begin_not_undoable_action();
+    text_buffer->insert(text_buffer->end(), data, data + size);
+    text_buffer->end_not_undoable_action();
+  }
+
+  return text_buffer;
+}
+
 static
 Glib::RefPtr<FileBuffer> load_iochannel(const Glib::RefPtr<Glib::IOChannel>& input)
 {
@@ -60,26 +151,291 @@ Glib::RefPtr<FileBuffer> load_iochannel(const Glib::RefPtr<Glib::IOChannel>& inp
   return text_buffer;
 }
 
+/*
+ * Return the file a symbolic link points to, so that saving replaces the
+ * target rather than the link itself.  Other names are returned as is.
+ */
+static
+std::string resolve_symlink(const std::string& filename)
+{
+  struct stat info;
+
+  if (g_lstat(filename.c_str(), &info) == 0 && S_ISLNK(info.st_mode))
+  {
+    if (char* const resolved = realpath(filename.c_str(), 0))
+    {
+      const std::string target = resolved;
+      std::free(resolved);
+      return target;
+    }
+  }
+  return filename;
+}
+
+/*
+ * Flush the directory entry of filename to disk, so that a rename survives
+ * a crash as well.  Not every file system supports this, thus errors are
+ * ignored.
+ */
 static
-void save_iochannel(const Glib::RefPtr<Glib::IOChannel>& output, const Glib::RefPtr<FileBuffer>& buffer)
+void sync_directory(const std::string& filename)
 {
-  FileBuffer::iterator stop = buffer->begin();
+  const int fd = g_open(Glib::path_get_dirname(filename).c_str(), O_RDONLY, 0);
+
+  if (fd >= 0)
+  {
+    fsync(fd);
+    close(fd);
+  }
+}
 
-  for (FileBuffer::iterator start = stop; start; start = stop)
+/*
+ * A temporary file in the same directory as filename, which takes the
+ * place of filename once commit() has been called.  Thus the original file
+ * stays intact if anything goes wrong in between, including a crash: the
+ * data is synced to disk before the rename.  The temporary file gets the
+ * mode and ownership of the original.  The data written is UTF-8, and is
+ * either collected into large writes as is, or converted to encoding on
+ * the fly.  The temporary file isn't created before something is written
+ * to it or commit() is called.
+ *
+ * If the directory isn't writable or the owner can't be kept, then with
+ * in_place_fallback the original is overwritten directly, as a last resort.
+ * The same goes for a file with several hard links, which a rename would
+ * split up.  That must not be allowed if the data comes from a mapping of
+ * the file, so without in_place_fallback NeedsInPlace is thrown instead.
+ * The caller can then copy the data and try again.
+ */
+class ReplacementFile
+{
+private:
+  std::string                   filename_;
+  std::string                   target_;
+  std::string                   encoding_;
+  std::string                   temp_filename_;
+  int                           fd_;
+  Glib::RefPtr<Glib::IOChannel> channel_;
+  std::string                   buffer_;
+  bool                          in_place_fallback_;
+  bool                          committed_;
+
+  ReplacementFile(const ReplacementFile&);
+  ReplacementFile& operator=(const ReplacementFile&);
+
+  void open();
+  int  open_temp(const struct stat& info);
+  void write_fd(const char* data, std::size_t size);
+  void flush();
+  void throw_error(int error_code) const;
+
+public:
+  class NeedsInPlace {};
+
+  ReplacementFile(const std::string& filename, const std::string& encoding,
+                  bool in_place_fallback);
+  ~ReplacementFile();
+
+  void write(const char* data, std::size_t size);
+  void commit();
+};
+
+ReplacementFile::ReplacementFile(const std::string& filename, const std::string& encoding,
+                                 bool in_place_fallback)
+:
+  filename_          (filename),
+  target_            (resolve_symlink(filename)),
+  encoding_          (encoding),
+  temp_filename_     (),
+  fd_                (-1),
+  channel_           (),
+  buffer_            (),
+  in_place_fallback_ (in_place_fallback),
+  committed_         (false)
+{}
+
+ReplacementFile::~ReplacementFile()
+{
+  if (!committed_)
+  {
+    // The channel doesn't own the file descriptor.
+    channel_.reset();
+
+    if (fd_ >= 0)
+      close(fd_);
+
+    if (!temp_filename_.empty())
+      g_unlink(temp_filename_.c_str());
+  }
+}
+
+void ReplacementFile::open()
+{
+  struct stat info;
+
+  if (g_stat(target_.c_str(), &info) < 0)
+    throw_error(errno);
+
+  // Renaming a new file over the original would detach it from its other
+  // hard links, so rewrite such a file in place.
+  const bool linked     = (info.st_nlink > 1);
+  const int  error_code = (linked) ? 0 : open_temp(info);
+
+  if (linked || error_code != 0)
+  {
+    if (!in_place_fallback_)
+      throw NeedsInPlace();
+
+    fd_ = g_open(target_.c_str(), O_WRONLY | O_TRUNC, 0);
+
+    if (fd_ < 0)
+      throw_error(errno);
+  }
+
+  // Valid UTF-8 is written as is, without going through a channel.
+  if (!Util::encodings_equal(encoding_, "UTF-8"))
+  {
+    channel_ = Glib::IOChannel::create_from_fd(fd_);
+    channel_->set_encoding(encoding_);
+    channel_->set_buffer_size(WRITE_BUFSIZE);
+  }
+  else
+  {
+    buffer_.reserve(WRITE_BUFSIZE);
+  }
+}
+
+/*
+ * Returns 0 on success, or the error code if no temporary file with the
+ * mode and ownership of the original could be created.
+ */
+int ReplacementFile::open_temp(const struct stat& info)
+{
+  std::string temp_filename = target_;
+  temp_filename += ".XXXXXX";
+
+  const int fd = g_mkstemp_full(&temp_filename[0], O_WRONLY, info.st_mode & 07777);
+
+  if (fd < 0)
+    return errno;
+
+  // Changing the owner clears the set-id bits, and the umask has been
+  // applied on creation, so set the mode explicitly afterwards.
+  if (fchown(fd, info.st_uid, info.st_gid) < 0 || fchmod(fd, info.st_mode & 07777) < 0)
+  {
+    const int error_code = errno;
+
+    close(fd);
+    g_unlink(temp_filename.c_str());
+
+    return error_code;
+  }
+
+  fd_ = fd;
+  temp_filename_ = temp_filename;
+
+  return 0;
+}
+
+void ReplacementFile::write_fd(const char* data, std::size_t size)
+{
+  while (size > 0)
+  {
+    const ssize_t bytes_written = ::write(fd_, data, size);
+
+    if (bytes_written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      throw_error(errno);
+    }
+
+    data += bytes_written;
+    size -= bytes_written;
+  }
+}
+
+void ReplacementFile::flush()
+{
+  if (channel_)
+  {
+    channel_->flush();
+  }
+  else if (!buffer_.empty())
   {
-    stop.forward_chars(BUFSIZE); // inaccurate, but doesn't matter
-    const Glib::ustring chunk = buffer->get_slice(start, stop);
+    write_fd(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+}
+
+void ReplacementFile::throw_error(int error_code) const
+{
+  throw Glib::FileError(Glib::FileError::Code(g_file_error_from_errno(error_code)),
+                        Util::compose(_("Failed to save file \342\200\234%1\342\200\235: %2"),
+                                      Glib::filename_display_name(filename_),
+                                      g_strerror(error_code)));
+}
+
+void ReplacementFile::write(const char* data, std::size_t size)
+{
+  if (fd_ < 0)
+    open();
 
+  if (channel_)
+  {
     gsize bytes_written = 0;
-    const Glib::IOStatus status = output->write(chunk.data(), chunk.bytes(), bytes_written);
+    const Glib::IOStatus status = channel_->write(data, size, bytes_written);
 
-    // These conditions really must hold true at this point
-    // since any error should have caused an exception.
+    // Any error should have caused an exception.
     g_assert(status == Glib::IO_STATUS_NORMAL);
-    g_assert(bytes_written == chunk.bytes());
+    g_assert(bytes_written == size);
+  }
+  else if (buffer_.size() + size <= WRITE_BUFSIZE)
+  {
+    buffer_.append(data, size);
+  }
+  else
+  {
+    flush();
+
+    if (size < WRITE_BUFSIZE)
+      buffer_.append(data, size);
+    else
+      write_fd(data, size); // large enough already
   }
 }
 
+void ReplacementFile::commit()
+{
+  g_return_if_fail(!committed_);
+
+  if (fd_ < 0)
+    open(); // nothing written, but the file is replaced anyway
+
+  flush();
+
+  // Make sure the data is on disk before the file takes the place of the
+  // original, or else a crash might leave an empty file behind.
+  if (fsync(fd_) < 0)
+    throw_error(errno);
+
+  channel_.reset();
+
+  const int fd = fd_;
+  fd_ = -1;
+
+  if (close(fd) < 0)
+    throw_error(errno);
+
+  if (!temp_filename_.empty() && g_rename(temp_filename_.c_str(), target_.c_str()) < 0)
+    throw_error(errno);
+
+  committed_ = true;
+
+  if (!temp_filename_.empty())
+    sync_directory(target_);
+}
+
 static
 Glib::RefPtr<FileBuffer> load_try_encoding(const std::string& filename, const std::string& encoding)
 {
@@ -98,6 +454,56 @@ Glib::RefPtr<FileBuffer> load_try_encoding(const std::string& filename, const st
   return Glib::RefPtr<FileBuffer>();
 }
 
+static
+bool text_try_encoding(const char* data, gsize size, const std::string& encoding,
+                       std::string& text)
+{
+  gsize  bytes_written = 0;
+  gchar* converted = g_convert(data, size, "UTF-8", encoding.c_str(), 0, &bytes_written, 0);
+
+  if (!converted)
+    return false;
+
+  text.assign(converted, bytes_written);
+  g_free(converted);
+
+  return true;
+}
+
+static
+void install_file_buffer(const Regexxer::FileInfoPtr& fileinfo,
+                         const Glib::RefPtr<FileBuffer>& buffer, const std::string& encoding)
+{
+  buffer->set_modified(false);
+
+  fileinfo->encoding         = encoding;
+  fileinfo->buffer           = buffer;
+  fileinfo->load_failed      = false;
+  fileinfo->language_guessed = false;
+}
+
+/*
+ * Stream the result of the substitution into a ReplacementFile, which is
+ * committed if there were any matches.
+ */
+static
+int stream_to_file(const std::string& filename, const std::string& encoding,
+                   bool in_place_fallback, const char* text, gsize size,
+                   const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                   const Glib::ustring& substitution,
+                   const sigc::slot<void, int, const Glib::ustring&>& feedback)
+{
+  ReplacementFile output (filename, encoding, in_place_fallback);
+
+  const int match_count =
+      Regexxer::stream_substitute(pattern, multiple, text, size, substitution,
+                                  sigc::mem_fun(output, &ReplacementFile::write), feedback);
+  if (match_count > 0)
+    output.commit();
+
+  return match_count;
+}
+
 } // anonymous namespace
 
 
@@ -126,8 +532,11 @@ DirInfo::~DirInfo()
 
 FileInfo::FileInfo(const std::string& fullname_)
 :
-  fullname    (fullname_),
-  load_failed (false)
+  fullname         (fullname_),
+  load_failed      (false),
+  language_guessed (false),
+  search_stamp     (),
+  size             (0)
 {}
 
 FileInfo::~FileInfo()
@@ -138,10 +547,13 @@ FileInfo::~FileInfo()
 
 void load_file(const FileInfoPtr& fileinfo, const std::string& fallback_encoding)
 {
+  // The text is decoded while it is read, so it's all accounted as reading.
+  ScopedTimer timer (STATS_READ);
+
   fileinfo->load_failed = true;
 
   std::string encoding = "UTF-8";
-  Glib::RefPtr<FileBuffer> buffer = load_try_encoding(fileinfo->fullname, encoding);
+  Glib::RefPtr<FileBuffer> buffer = load_mapped_utf8(fileinfo->fullname);
 
   if (!buffer && !Glib::get_charset(encoding)) // locale charset is _not_ UTF-8
   {
@@ -157,35 +569,185 @@ void load_file(const FileInfoPtr& fileinfo, const std::string& fallback_encoding
   if (!buffer)
     throw ErrorBinaryFile();
 
-  Glib::RefPtr<Gsv::LanguageManager> language_manager = Gsv::LanguageManager::create();
-  
+  install_file_buffer(fileinfo, buffer, encoding);
+}
+
+void load_file_from_text(const FileInfoPtr& fileinfo, const std::string& text,
+                         const std::string& encoding)
+{
+  ScopedTimer timer (STATS_BUFFER);
+  Stats::add_bytes(STATS_BUFFER, text.size());
+
+  fileinfo->load_failed = true;
+
+  const Glib::RefPtr<FileBuffer> buffer = FileBuffer::create();
+
+  buffer->begin_not_undoable_action();
+  buffer->insert(buffer->end(), text.data(), text.data() + text.size());
+  buffer->end_not_undoable_action();
+
+  install_file_buffer(fileinfo, buffer, encoding);
+}
+
+void install_syntax_highlighting(const FileInfoPtr& fileinfo)
+{
+  const Glib::RefPtr<FileBuffer> buffer = fileinfo->buffer;
+  g_return_if_fail(buffer);
+
+  // Files of no known language would otherwise be guessed at every time.
+  if (fileinfo->load_failed || fileinfo->language_guessed)
+    return;
+
+  ScopedTimer timer (STATS_LANGUAGE);
+
+  fileinfo->language_guessed = true;
+
+  const Glib::RefPtr<Gsv::LanguageManager> language_manager =
+      Gsv::LanguageManager::get_default();
+
+  // The content type can be determined from the start of the file just as
+  // well, so avoid copying all of the text.
+  const Glib::ustring sample = buffer->get_text(buffer->begin(),
+                                                buffer->get_iter_at_offset(CONTENT_SAMPLE_SIZE));
   bool uncertain = false;
-  std::string content_type = Gio::content_type_guess(fileinfo->fullname, buffer->get_text(), uncertain);
+  const std::string content_type = Gio::content_type_guess(fileinfo->fullname, sample, uncertain);
 
   buffer->set_highlight_syntax(true);
   buffer->set_language(language_manager->guess_language(fileinfo->fullname, content_type));
+}
+
+void save_file(const FileInfoPtr& fileinfo)
+{
+  const Glib::RefPtr<FileBuffer> buffer = fileinfo->buffer;
+
+  // Copy the text in one go, so that it is written in large blocks.
+  save_text(fileinfo->fullname, fileinfo->encoding, buffer->get_text().raw());
+
   buffer->set_modified(false);
+}
+
+void load_text(const std::string& filename, const std::string& fallback_encoding,
+               std::string& text, std::string& encoding)
+{
+  const ScopedMappedFile mapped (filename);
+
+  const char* const data = mapped.data();
+  const gsize       size = mapped.size();
+  const char*       invalid = 0;
+  bool              converted = false;
+
+  {
+    // The pages of the mapping are read while validating.
+    ScopedTimer timer (STATS_READ);
+    Stats::add_bytes(STATS_READ, size);
+
+    // Just like in load_mapped_utf8(), validation catches nul bytes too.
+    converted = (size == 0 || g_utf8_validate(data, size, &invalid));
+
+    if (converted)
+    {
+      check_text_size(filename, size);
+      text.assign(data, size);
+    }
+    else if (std::memchr(invalid, '\0', data + size - invalid)) // binary file?
+      throw ErrorBinaryFile();
+  }
+
+  encoding = "UTF-8";
+
+  if (!converted)
+  {
+    ScopedTimer timer (STATS_DECODE);
+
+    // Try the same sequence of encodings as load_file().
+    if (!Glib::get_charset(encoding)) // locale charset is _not_ UTF-8
+    {
+      converted = text_try_encoding(data, size, encoding, text);
+    }
+
+    if (!converted && !Util::encodings_equal(encoding, fallback_encoding))
+    {
+      encoding = fallback_encoding;
+      converted = text_try_encoding(data, size, encoding, text);
+    }
+
+    // A multibyte encoding might still produce nul bytes from others.
+    if (!converted || std::memchr(text.data(), '\0', text.size()))
+      throw ErrorBinaryFile();
 
-  fileinfo->encoding    = encoding;
-  fileinfo->buffer      = buffer;
-  fileinfo->load_failed = false;
+    check_text_size(filename, text.size());
+  }
 }
 
-void save_file(const FileInfoPtr& fileinfo)
+void save_text(const std::string& filename, const std::string& encoding,
+               const std::string& text)
 {
-  const Glib::RefPtr<Glib::IOChannel> channel =
-      Glib::IOChannel::create_from_file(fileinfo->fullname, "w");
+  ScopedTimer timer (STATS_SAVE);
+  Stats::add_bytes(STATS_SAVE, text.size());
 
-  channel->set_buffer_size(BUFSIZE);
-  channel->set_encoding(fileinfo->encoding);
+  ReplacementFile output (filename, encoding, true);
+
+  output.write(text.data(), text.size());
+  output.commit();
+}
+
+int rewrite_file(const std::string& filename, const std::string& fallback_encoding,
+                 const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                 const Glib::ustring& substitution,
+                 const sigc::slot<void, int, const Glib::ustring&>& feedback)
+{
+  // Reading, matching and writing are interleaved here, so it's all
+  // accounted as replacing.
+  ScopedTimer timer (STATS_REPLACE);
+
+  const ScopedMappedFile mapped (filename);
+
+  std::string encoding = "UTF-8";
+  std::string converted;
+  bool        in_memory = false;
+  const char* text    = mapped.data();
+  gsize       size    = mapped.size();
+  const char* invalid = 0;
+  int         match_count = 0;
+
+  if (size > 0 && !g_utf8_validate(text, size, &invalid))
+  {
+    if (*invalid == '\0') // binary file?
+      throw ErrorBinaryFile();
 
-  save_iochannel(channel, fileinfo->buffer);
+    load_text(filename, fallback_encoding, converted, encoding);
+
+    text = converted.data();
+    size = converted.size();
+    in_memory = true;
+  }
+
+  check_text_size(filename, size);
+
+  try
+  {
+    // The mapping stays valid after the file has been replaced, but not if
+    // the file is overwritten.
+    match_count = stream_to_file(filename, encoding, in_memory, text, size,
+                                 pattern, multiple, substitution, feedback);
+  }
+  catch (const ReplacementFile::NeedsInPlace&)
+  {
+    // Nothing has been written yet, so start over with a copy of the text,
+    // which allows for overwriting the file directly.
+    load_text(filename, fallback_encoding, converted, encoding);
+
+    text = converted.data();
+    size = converted.size();
+
+    match_count = stream_to_file(filename, encoding, true, text, size,
+                                 pattern, multiple, substitution, feedback);
+  }
 
-  // Explicitely close() the buffer at this point so that
-  // we get an exception if closing the file fails.
-  channel->close();
+  Stats::add_bytes(STATS_REPLACE, size);
+  Stats::add_matches(match_count);
 
-  fileinfo->buffer->set_modified(false);
+  return match_count;
 }
 
 } // namespace Regexxer
@@ -22,8 +22,13 @@
 #define REGEXXER_FILEIO_H_INCLUDED
 
 #include "sharedptr.h"
+#include "trigramindex.h"
 #include <string>
 #include <glibmm/refptr.h>
+#include <glibmm/ustring.h>
+#include <sigc++/sigc++.h>
+
+namespace Glib { class Regex; }
 
 
 namespace Regexxer
@@ -52,6 +57,9 @@ struct FileInfo : public FileInfoBase
   std::string               encoding;
   Glib::RefPtr<FileBuffer>  buffer;
   bool                      load_failed;
+  bool                      language_guessed; // for the current buffer
+  FileStamp                 search_stamp; // if the last search found nothing
+  gint64                    size;         // on disk, as last seen
 
   explicit FileInfo(const std::string& fullname_);
   virtual ~FileInfo();
@@ -66,6 +74,57 @@ class ErrorBinaryFile {}; // exception type
 void load_file(const FileInfoPtr& fileinfo, const std::string& fallback_encoding);
 void save_file(const FileInfoPtr& fileinfo);
 
+/*
+ * Guess the language of the file and turn on syntax highlighting for its
+ * buffer.  This is deferred until the buffer is actually displayed, since
+ * most of the buffers created by a search never are.
+ */
+void install_syntax_highlighting(const FileInfoPtr& fileinfo);
+
+/*
+ * Create the buffer of fileinfo from text that has already been read and
+ * converted to UTF-8 by load_text(), for instance on a worker thread.
+ */
+void load_file_from_text(const FileInfoPtr& fileinfo, const std::string& text,
+                         const std::string& encoding);
+
+/*
+ * GTK+-free counterparts of load_file() and save_file(), for code that
+ * works on plain text instead of a FileBuffer.  The text is always UTF-8
+ * encoded; load_text() stores the encoding it was converted from in the
+ * encoding argument, and save_text() converts back to that encoding.
+ *
+ * Saving never truncates the original file in place: the data is written
+ * to a temporary file in the same directory, synced to disk, and renamed
+ * over the original, with its mode and ownership.  Only if that isn't
+ * possible, or the file has several hard links, the file is overwritten
+ * directly.
+ */
+void load_text(const std::string& filename, const std::string& fallback_encoding,
+               std::string& text, std::string& encoding);
+void save_text(const std::string& filename, const std::string& encoding,
+               const std::string& text);
+
+/*
+ * Substitute the matches of pattern in a file that hasn't been loaded.  The
+ * file is never read into a FileBuffer: if it is valid UTF-8, it is mapped
+ * into memory and the result is streamed into a temporary file, which
+ * replaces the original once it's complete.  Other encodings have to be
+ * converted in memory first, and files which can only be overwritten in
+ * place are read into memory as well.  The encoding of the file is kept.  Files
+ * without matches are left alone.  Returns the number of matches, and calls
+ * feedback for the first match of every line if given.
+ *
+ * Only batch mode uses this.  The GUI never writes a file behind the back
+ * of the user: every file with matches has a FileBuffer anyway to show them,
+ * and replacing edits that buffer so the result can be reviewed, undone and
+ * saved explicitly.
+ */
+int rewrite_file(const std::string& filename, const std::string& fallback_encoding,
+                 const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                 const Glib::ustring& substitution,
+                 const sigc::slot<void, int, const Glib::ustring&>& feedback);
+
 } // namespace Regexxer
 
 #endif /* REGEXXER_FILEIO_H_INCLUDED */
@@ -27,83 +27,387 @@
 namespace
 {
 
+// Marks a capture that didn't participate in the match.  This can't be -1
+// since capture bounds are relative to the match start and thus may well be
+// negative, e.g. if the capturing group is part of a lookbehind assertion.
+enum { CAPTURE_UNSET = G_MININT };
+
 static
-const Glib::Quark& file_buffer_match_quark()
+bool is_char_boundary(const std::string& text, int index)
+{
+  return (std::string::size_type(index) >= text.size() || (text[index] & 0xC0) != 0x80);
+}
+
+} // anonymous namespace
+
+
+namespace Regexxer
 {
-  // Regexxer::FileBuffer uses anonymous Gtk::TextMark objects to remember
-  // the position of matches.  This quark is used to identify a match mark,
-  // in order to be able to distinguish it from other anonymous marks.
 
-  static Glib::Quark quark ("regexxer-file-buffer-match-quark");
-  return quark;
+/**** Regexxer::MatchTable *************************************************/
+
+MatchTable::MatchTable()
+:
+  offset_        (),
+  shift_tree_    (1, 0),
+  length_        (),
+  live_          (),
+  capture_begin_ (1, 0),
+  captures_      (),
+  live_count_    (0),
+  first_live_    (-1),
+  last_live_     (-1)
+{}
+
+MatchTable::~MatchTable()
+{}
+
+void MatchTable::clear()
+{
+  // Swap with empty vectors to actually release the memory.
+  std::vector<int>().swap(offset_);
+  std::vector<int>(1, 0).swap(shift_tree_);
+  std::vector<int>().swap(length_);
+  std::vector<bool>().swap(live_);
+  std::vector<int>(1, 0).swap(capture_begin_);
+  std::vector< std::pair<int, int> >().swap(captures_);
+
+  live_count_ = 0;
+  first_live_ = -1;
+  last_live_  = -1;
 }
 
-static
-int calculate_match_length(const Glib::ustring& subject, const std::pair<int, int>& bounds)
+void MatchTable::swap(MatchTable& other)
+{
+  offset_.swap(other.offset_);
+  shift_tree_.swap(other.shift_tree_);
+  length_.swap(other.length_);
+  live_.swap(other.live_);
+  capture_begin_.swap(other.capture_begin_);
+  captures_.swap(other.captures_);
+
+  std::swap(live_count_, other.live_count_);
+  std::swap(first_live_, other.first_live_);
+  std::swap(last_live_,  other.last_live_);
+}
+
+/*
+ * Append a match at the end of the table and return its slot.  The offset
+ * and length are measured in characters.  The capture bounds are byte
+ * offsets relative to an arbitrary subject, as returned by scan_text().
+ */
+int MatchTable::append(int offset, int length, const Util::CaptureVector& captures)
 {
-  const std::string::const_iterator begin = subject.begin().base();
+  g_return_val_if_fail(!captures.empty(), -1);
+  g_return_val_if_fail(offset_.empty() || offset >= get_offset(offset_.size() - 1), -1);
+
+  const int slot  = append_entry(offset, length);
+  const int start = captures.front().first;
 
-  const Glib::ustring::const_iterator start (begin + bounds.first);
-  const Glib::ustring::const_iterator stop  (begin + bounds.second);
+  for (Util::CaptureVector::const_iterator p = captures.begin(); p != captures.end(); ++p)
+  {
+    if (p->first >= 0)
+      captures_.push_back(std::make_pair(p->first - start, p->second - start));
+    else
+      captures_.push_back(std::make_pair(int(CAPTURE_UNSET), int(CAPTURE_UNSET)));
+  }
+  capture_begin_.push_back(captures_.size());
 
-  return std::distance(start, stop);
+  return slot;
 }
 
-} // anonymous namespace
+int MatchTable::append_from(const MatchTable& source, int slot)
+{
+  const int offset = source.get_offset(slot);
 
+  g_return_val_if_fail(offset_.empty() || offset >= get_offset(offset_.size() - 1), -1);
 
-namespace Regexxer
+  const int new_slot = append_entry(offset, source.length_[slot]);
+
+  // The captures are relative to the match start already.
+  captures_.insert(captures_.end(), source.captures_.begin() + source.capture_begin_[slot],
+                                    source.captures_.begin() + source.capture_begin_[slot + 1]);
+  capture_begin_.push_back(captures_.size());
+
+  return new_slot;
+}
+
+void MatchTable::get_captures(int slot, int shift, const std::string& subject,
+                              Util::CaptureVector& captures) const
 {
+  const std::vector< std::pair<int, int> >::const_iterator pbegin = captures_.begin();
+  const int subject_size = subject.size();
 
-/**** Regexxer::MatchData **************************************************/
+  captures.assign(pbegin + capture_begin_[slot], pbegin + capture_begin_[slot + 1]);
 
-MatchData::MatchData(int match_index, const Glib::ustring& line,
-                     Glib::MatchInfo& match_info)
-:
-  index   (match_index),
-  subject (line)
+  for (Util::CaptureVector::iterator p = captures.begin(); p != captures.end(); ++p)
+  {
+    // Captures outside the match might reach beyond the subject, which
+    // is fetched anew from the buffer.  An edit within the context of a
+    // lookaround might even have moved them into the middle of a UTF-8
+    // sequence.  Treat those as unset.
+    if (p->first != CAPTURE_UNSET && p->first + shift >= 0 && p->first + shift <= subject_size)
+    {
+      p->first  += shift;
+      p->second  = std::min(p->second + shift, subject_size);
+
+      if (is_char_boundary(subject, p->first) && is_char_boundary(subject, p->second))
+        continue;
+    }
+    p->first  = -1;
+    p->second = -1;
+  }
+}
+
+void MatchTable::remove(int slot)
+{
+  g_return_if_fail(live_[slot]);
+
+  live_[slot] = false;
+  --live_count_;
+
+  if (slot == first_live_)
+    first_live_ = next_live(slot);
+
+  if (slot == last_live_)
+    last_live_ = prev_live(slot);
+}
+
+void MatchTable::revive(int slot, int offset)
 {
-  int capture_count = match_info.get_match_count();
-  captures.reserve(capture_count);
+  g_return_if_fail(!live_[slot]);
+
+  const int prev = prev_live(slot);
+  const int next = next_live(slot);
+  const int stop = (next >= 0) ? next : int(offset_.size());
+
+  // Edits since the removal have moved the tombstones around the slot, so
+  // the offset handed back by the undo history might be out of order with
+  // them.  Clamp it between the live neighbours and drag the tombstones in
+  // between along, so that the offsets of all slots remain sorted.
+  if (prev >= 0)
+    offset = std::max(offset, get_offset(prev) + length_[prev]);
+  if (next >= 0)
+    offset = std::min(offset, get_offset(next));
+
+  for (int i = slot - 1; i > prev && get_offset(i) > offset; --i)
+    set_offset(i, offset);
+
+  for (int i = slot + 1; i < stop && get_offset(i) < offset; ++i)
+    set_offset(i, offset);
+
+  live_[slot] = true;
+  set_offset(slot, offset);
+  ++live_count_;
 
-  for (int i = 0; i < capture_count; ++i)
+  if (first_live_ < 0 || slot < first_live_)
+    first_live_ = slot;
+
+  if (last_live_ < slot)
+    last_live_ = slot;
+}
+
+int MatchTable::next_live(int slot) const
+{
+  while (++slot <= last_live_)
   {
-    std::pair<int, int> bounds;
-    match_info.fetch_pos(i, bounds.first, bounds.second);
-    captures.push_back(bounds);
+    if (live_[slot])
+      return slot;
   }
+  return -1;
+}
 
-  length = calculate_match_length(subject, captures.front());
+int MatchTable::prev_live(int slot) const
+{
+  while (--slot >= first_live_ && slot >= 0)
+  {
+    if (live_[slot])
+      return slot;
+  }
+  return -1;
 }
 
-MatchData::~MatchData()
+int MatchTable::find_enclosing(int offset) const
 {
-  // We *should* be the only one holding a reference to the Mark apart from
-  // the Gtk::TextBuffer itself.  Nonetheless, let's better be extra careful
-  // and invalidate the reference.
-  if (mark)
-    mark->steal_data(file_buffer_match_quark());
+  // The live matches don't overlap, so only the last one starting
+  // before offset can possibly enclose it.
+  for (int slot = find_first_at(offset) - 1; slot >= first_live_ && slot >= 0; --slot)
+  {
+    if (live_[slot])
+      return (get_offset(slot) + length_[slot] > offset) ? slot : -1;
+  }
+  return -1;
 }
 
-void MatchData::install_mark(const Gtk::TextBuffer::iterator& pos)
+int MatchTable::find_first_at(int offset) const
 {
-  g_return_if_fail(!mark);
+  int first = 0;
+  int last  = offset_.size();
 
-  mark = pos.get_buffer()->create_mark(pos, false); // right gravity
+  while (first < last)
+  {
+    const int middle = first + (last - first) / 2;
 
-  mark->set_data(file_buffer_match_quark(), this);
+    if (get_offset(middle) < offset)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+  return first;
 }
 
-// static
-bool MatchData::is_match_mark(const Glib::RefPtr<Gtk::TextMark>& textmark)
+/*
+ * Shift the matches after an insertion of length characters at offset.
+ * A match starting right at offset is moved too, just like a TextMark
+ * with right gravity.  Removed matches are adjusted as well, so that the
+ * offsets remain sorted.
+ */
+void MatchTable::adjust_insert(int offset, int length)
 {
-  return (textmark->get_data(file_buffer_match_quark()) != 0);
+  add_shift(find_first_at(offset), length);
 }
 
-// static
-Util::SharedPtr<MatchData> MatchData::get_from_mark(const Glib::RefPtr<Gtk::TextMark>& textmark)
+/*
+ * Shift the matches after the range [begin,end) has been erased.  Any
+ * match starting within the range is moved to its beginning.
+ */
+void MatchTable::adjust_erase(int begin, int end)
+{
+  const int first = find_first_at(begin);
+  const int last  = find_first_at(end);
+
+  for (int slot = first; slot < last; ++slot)
+    set_offset(slot, begin);
+
+  add_shift(last, begin - end);
+}
+
+/*
+ * Add a live entry for a match at the end of the table, except for its
+ * captures, and return its slot.
+ */
+int MatchTable::append_entry(int offset, int length)
+{
+  const int slot = offset_.size();
+
+  // The new tree node covers the slots (slot + 1 - lowbit, slot + 1], of
+  // which only the new one doesn't yet have its shift recorded.
+  const int node = slot + 1;
+  shift_tree_.push_back(get_shift(slot - 1) - get_shift(node - (node & -node) - 1));
+
+  offset_.push_back(0);
+  set_offset(slot, offset);
+  length_.push_back(length);
+  live_.push_back(true);
+
+  if (first_live_ < 0)
+    first_live_ = slot;
+
+  last_live_ = slot;
+  ++live_count_;
+
+  return slot;
+}
+
+/*
+ * Return the sum of the shifts applied to the slot, or 0 for slot -1.
+ */
+int MatchTable::get_shift(int slot) const
+{
+  int sum = 0;
+
+  for (int node = slot + 1; node > 0; node &= node - 1)
+    sum += shift_tree_[node];
+
+  return sum;
+}
+
+/*
+ * Shift the slot and all slots after it by delta.
+ */
+void MatchTable::add_shift(int slot, int delta)
+{
+  const int size = shift_tree_.size();
+
+  for (int node = slot + 1; node < size; node += node & -node)
+    shift_tree_[node] += delta;
+}
+
+void MatchTable::set_offset(int slot, int offset)
+{
+  offset_[slot] = offset - get_shift(slot);
+}
+
+/**** Regexxer::DirtyRangeList *********************************************/
+
+DirtyRangeList::DirtyRangeList()
+:
+  ranges_ ()
+{}
+
+DirtyRangeList::~DirtyRangeList()
+{}
+
+int DirtyRangeList::get_size() const
+{
+  int size = 0;
+
+  for (RangeVector::const_iterator p = ranges_.begin(); p != ranges_.end(); ++p)
+    size += p->second - p->first;
+
+  return size;
+}
+
+/*
+ * Mark [begin,end) as dirty, merging it with the ranges it overlaps or
+ * touches.  There are usually just a few ranges, since edits tend to be
+ * close to each other.
+ */
+void DirtyRangeList::add(int begin, int end)
 {
-  return MatchDataPtr(static_cast<MatchData*>(textmark->get_data(file_buffer_match_quark())));
+  RangeVector::iterator first = ranges_.begin();
+
+  while (first != ranges_.end() && first->second < begin)
+    ++first;
+
+  RangeVector::iterator last = first;
+
+  while (last != ranges_.end() && last->first <= end)
+  {
+    begin = std::min(begin, last->first);
+    end   = std::max(end,   last->second);
+    ++last;
+  }
+
+  first = ranges_.erase(first, last);
+  ranges_.insert(first, std::make_pair(begin, end));
+}
+
+void DirtyRangeList::adjust_insert(int offset, int length)
+{
+  for (RangeVector::iterator p = ranges_.begin(); p != ranges_.end(); ++p)
+  {
+    if (p->first > offset)
+      p->first += length;
+
+    if (p->second >= offset)
+      p->second += length;
+  }
+
+  add(offset, offset + length);
+}
+
+void DirtyRangeList::adjust_erase(int begin, int end)
+{
+  for (RangeVector::iterator p = ranges_.begin(); p != ranges_.end(); ++p)
+  {
+    p->first  = (p->first  >= end) ? p->first  - (end - begin) : std::min(p->first,  begin);
+    p->second = (p->second >= end) ? p->second - (end - begin) : std::min(p->second, begin);
+  }
+
+  // Ranges within the erased part collapse onto begin, where add() merges
+  // them into one.
+  add(begin, begin);
 }
 
 } // namespace Regexxer
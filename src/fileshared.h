@@ -21,10 +21,9 @@
 #ifndef REGEXXER_FILESHARED_H_INCLUDED
 #define REGEXXER_FILESHARED_H_INCLUDED
 
-#include "sharedptr.h"
+#include "stringutils.h"
 
-#include <gtkmm/textbuffer.h>
-#include <functional>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -60,45 +59,122 @@ inline BoundState& operator^=(BoundState& a, BoundState b)
   { return (a = static_cast<BoundState>(static_cast<unsigned>(a) ^ static_cast<unsigned>(b))); }
 
 /*
- * This struct holds all the information that's necessary to locate a
- * match's position in the buffer and to substitute captured substrings
- * into a replacement string.  The latter is achieved by storing the whole
- * subject string (i.e. the line in the buffer) together with a table of
- * indices into it.  This arrangement should consume less memory than the
- * alternative of storing a vector of captured substrings since we want
- * to support $&, $`, $' too.
+ * The matches of a FileBuffer, stored as a table of flat arrays instead of
+ * one heap-allocated object per match.  A match is identified by its slot,
+ * which is also its index in the order the matches were found.  Removed
+ * matches leave a tombstone behind, so that a slot remains valid until the
+ * table is cleared and the undo machinery can revive it in place.
+ *
+ * Positions are character offsets into the buffer, which the owner has to
+ * keep up to date by calling adjust_insert() and adjust_erase() on every
+ * change of the text.  The offsets are split into the value at the time a
+ * match was recorded and the sum of the shifts since, which are kept in a
+ * Fenwick tree.  Thus an edit costs O(log n) instead of touching every
+ * match after it.  The subject string isn't stored at all: the capture
+ * bounds are byte offsets relative to the start of the match, so that they
+ * can be applied to the line or lines around the match as fetched from the
+ * buffer on demand.  Thus the text of the buffer isn't duplicated.
  */
-struct MatchData : public Util::SharedObject
+class MatchTable
 {
-  int                                index;
-  int                                length;
-  Glib::ustring                      subject;
-  std::vector< std::pair<int, int> > captures;
-  Glib::RefPtr<Gtk::TextMark>        mark;
+public:
+  MatchTable();
+  ~MatchTable();
+
+  void clear();
+  void swap(MatchTable& other);
+  int  append(int offset, int length, const Util::CaptureVector& captures);
+
+  // Append a copy of a match of another table, at its current offset.
+  int  append_from(const MatchTable& source, int slot);
+
+  int  get_live_count() const { return live_count_; }
+  bool is_live(int slot) const { return live_[slot]; }
+
+  int  get_offset(int slot) const { return offset_[slot] + get_shift(slot); }
+  int  get_length(int slot) const { return length_[slot]; }
 
-  MatchData(int match_index, const Glib::ustring& line,
-            Glib::MatchInfo& match_info);
-  ~MatchData();
+  // Retrieve the capture bounds, relative to a subject that contains the
+  // match at byte position shift.
+  void get_captures(int slot, int shift, const std::string& subject,
+                    Util::CaptureVector& captures) const;
 
-  void install_mark(const Gtk::TextBuffer::iterator& pos);
+  void remove(int slot);
+  void revive(int slot, int offset);
 
-  static bool                       is_match_mark(const Glib::RefPtr<Gtk::TextMark>& textmark);
-  static Util::SharedPtr<MatchData> get_from_mark(const Glib::RefPtr<Gtk::TextMark>& textmark);
+  // These return -1 if there is no such match.
+  int  first_live() const { return first_live_; }
+  int  last_live()  const { return last_live_; }
+  int  next_live(int slot) const;
+  int  prev_live(int slot) const;
+
+  // Find the match that strictly encloses offset, i.e. starts before it and
+  // ends after it.  Returns -1 if there is none.
+  int  find_enclosing(int offset) const;
+
+  // Return the first slot at or after offset, or the size of the table.
+  int  find_first_at(int offset) const;
+  int  get_slot_count() const { return offset_.size(); }
+
+  void adjust_insert(int offset, int length);
+  void adjust_erase(int begin, int end);
 
 private:
-  MatchData(const MatchData&);
-  MatchData& operator=(const MatchData&);
+  std::vector<int>                   offset_;
+  std::vector<int>                   shift_tree_;
+  std::vector<int>                   length_;
+  std::vector<bool>                  live_;
+  std::vector<int>                   capture_begin_;
+  std::vector< std::pair<int, int> > captures_;
+  int                                live_count_;
+  int                                first_live_;
+  int                                last_live_;
+
+  int  append_entry(int offset, int length);
+  int  get_shift(int slot) const;
+  void add_shift(int slot, int delta);
+  void set_offset(int slot, int offset);
+
+  MatchTable(const MatchTable&);
+  MatchTable& operator=(const MatchTable&);
 };
 
-typedef Util::SharedPtr<MatchData> MatchDataPtr;
+// Pairs of slot and offset of removed matches, for reviving them later.
+typedef std::vector< std::pair<int, int> > MatchSlotList;
 
 /*
- * Sort predicate for use with std::set<>.
+ * The parts of a FileBuffer that changed since it was last searched, as a
+ * sorted list of disjoint ranges of character offsets.  Like MatchTable,
+ * it has to be kept up to date by calling adjust_insert() and adjust_erase()
+ * on every change of the text, which also mark the changed part as dirty.
+ * An erasure leaves an empty range behind, which still marks its line.
  */
-struct MatchDataLess : public std::binary_function<MatchDataPtr, MatchDataPtr, bool>
+class DirtyRangeList
 {
-  bool operator()(const MatchDataPtr& a, const MatchDataPtr& b) const
-    { return (a->index < b->index); }
+public:
+  typedef std::vector< std::pair<int, int> > RangeVector;
+
+  DirtyRangeList();
+  ~DirtyRangeList();
+
+  void clear() { ranges_.clear(); }
+  bool empty() const { return ranges_.empty(); }
+
+  const RangeVector& get_ranges() const { return ranges_; }
+
+  // The number of characters covered by all ranges.
+  int  get_size() const;
+
+  void add(int begin, int end);
+
+  void adjust_insert(int offset, int length);
+  void adjust_erase(int begin, int end);
+
+private:
+  RangeVector ranges_;
+
+  DirtyRangeList(const DirtyRangeList&);
+  DirtyRangeList& operator=(const DirtyRangeList&);
 };
 
 } // namespace Regexxer
@@ -21,6 +21,8 @@
 #include "filetree.h"
 #include "filetreeprivate.h"
 #include "globalstrings.h"
+#include "regexliterals.h"
+#include "stats.h"
 #include "stringutils.h"
 #include "translation.h"
 #include "settings.h"
@@ -30,6 +32,23 @@
 
 #include <config.h>
 
+namespace
+{
+
+// Timeout in milliseconds for waiting on a worker thread, after which the
+// progress reporter is polled again.  It's up to the reporter how often
+// that actually results in a GUI update.
+enum { WAIT_INTERVAL = 5 };
+
+static
+Glib::ustring compose_save_error(const std::string& fullname, const Glib::ustring& what)
+{
+  return Util::compose(_("Failed to save file \342\200\234%1\342\200\235: %2"),
+                       Glib::filename_display_basename(fullname), what);
+}
+
+} // anonymous namespace
+
 namespace Regexxer
 {
 
@@ -41,7 +60,8 @@ FileTree::FileTree()
 :
   treestore_      (Gtk::TreeStore::create(FileTreeColumns::instance())),
   color_modified_ ("#DF421E"), // accent red
-  sum_matches_    (0)
+  sum_matches_    (0),
+  last_multiple_  (false)
 {
   using namespace Gtk;
   using sigc::mem_fun;
@@ -105,9 +125,23 @@ FileTree::~FileTree()
 {}
 
 void FileTree::find_files(const std::string& dirname, const Glib::RefPtr<Glib::Regex>& pattern,
-                          bool recursive, bool hidden)
+                          bool recursive, bool hidden, ProgressReporter& progress)
 {
-  FindData find_data (pattern, recursive, hidden);
+  // Strip trailing separators, so that Glib::path_get_dirname() on the
+  // names built by the walker leads back to exactly this string.
+  std::string toplevel = dirname;
+
+  while (toplevel.size() > 1 && *toplevel.rbegin() == G_DIR_SEPARATOR)
+    toplevel.erase(toplevel.size() - 1);
+
+  FindData find_data (toplevel);
+
+  // Keep the search index of the directory around for repeated searches.
+  if (!Settings::instance()->get_boolean(conf_key_use_search_index))
+    search_index_.reset();
+  else if (!search_index_.get() || search_index_->get_toplevel() != toplevel
+           || search_index_->get_fallback_encoding() != fallback_encoding_)
+    search_index_.reset(new TrigramIndex(toplevel, fallback_encoding_));
 
   const bool modified_count_changed = (toplevel_.modified_count != 0);
 
@@ -123,14 +157,40 @@ void FileTree::find_files(const std::string& dirname, const Glib::RefPtr<Glib::R
   if (modified_count_changed)
     signal_modified_count_changed(); // emit
 
-  find_recursively(dirname, find_data);
+  {
+    const Glib::RefPtr<Gio::Settings> settings = Settings::instance();
+
+    DirWalker     walker (pattern, recursive, hidden);
+    WalkEntryList entries;
+
+    walker.set_exclude_patterns(settings->get_string_array(conf_key_exclude_patterns));
+    walker.set_use_ignore_files(settings->get_boolean(conf_key_use_ignore_files));
+    walker.start(toplevel);
+
+    // Just collect the files while the walker threads go on, and keep
+    // the file count up-to-date.  The tree is built in one go afterwards.
+    {
+      ScopedTimer timer (STATS_WALK);
+
+      for (bool more = true; more;)
+      {
+        if (progress.poll())
+          break; // the walker is cancelled on destruction
+
+        more = walker.fetch(entries, *find_data.error_list, WAIT_INTERVAL);
 
-  // Work around a strange misbehavior: the tree is kept sorted while the
-  // file search is in progress, which causes the scroll offset to change
-  // slightly.  This in turn confuses TreeView::set_cursor() -- the first
-  // call after the tree was completely filled just doesn't scroll.
-  if (toplevel_.file_count > 0)
-    scroll_to_row(Gtk::TreeModel::Path(1u, 0));
+        if (toplevel_.file_count != int(entries.size()))
+        {
+          progress.add_files_done(entries.size() - toplevel_.file_count);
+          toplevel_.file_count = entries.size();
+          signal_file_count_changed(); // emit
+        }
+      }
+    }
+
+    // Keep whatever has been found if the search was interrupted.
+    find_add_files(entries, find_data);
+  }
 
   signal_bound_state_changed(); // emit
 
@@ -162,18 +222,25 @@ void FileTree::save_current_file()
 
 void FileTree::save_all_files()
 {
-  Util::SharedPtr<MessageList> error_list (new MessageList());
+  SaveFilesData save_data (Settings::instance()->get_int(conf_key_save_queue_depth));
 
   {
     Util::ScopedBlock block (conn_modified_changed_);
 
+    // The text of every modified buffer is captured here, but written on
+    // the worker threads of the save pool.  No more than queue_depth files
+    // are in flight at once, which also bounds the memory taken by copies.
+    // The results are processed strictly in tree order.
     treestore_->foreach_iter(sigc::bind(
-        sigc::mem_fun(*this, &FileTree::save_file_at_iter),
-        sigc::ref(error_list)));
+        sigc::mem_fun(*this, &FileTree::save_files_at_iter),
+        sigc::ref(save_data)));
+
+    while (!save_data.jobs.empty())
+      save_files_finish(save_data);
   }
 
-  if (!error_list->empty())
-    throw Error(error_list);
+  if (!save_data.error_list->empty())
+    throw Error(save_data.error_list);
 }
 
 void FileTree::select_first_file()
@@ -222,16 +289,100 @@ BoundState FileTree::get_bound_state()
   return bound;
 }
 
-void FileTree::find_matches(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple)
+/*
+ * The progress reporter counts only the files which are actually read or
+ * scanned on a worker thread, since the others take hardly any time.
+ */
+void FileTree::find_matches(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                            ProgressReporter& progress)
 {
   {
     Util::ScopedBlock  block_conn (conn_match_count_);
     ScopedBlockSorting block_sort (*this);
-    FindMatchesData    find_data  (pattern, multiple);
+    FindMatchesData    find_data  (pattern, multiple, fallback_encoding_, progress);
+
+    // Files are only skipped if they didn't match the very same search
+    // before, which must have run to completion.
+    find_data.repeated = (last_multiple_ == multiple && is_same_pattern(last_pattern_, pattern));
+    last_pattern_.reset();
+
+    // Changing the settings drops the index, which might happen while the
+    // search is running.  So keep it here until the search is done.
+    std::auto_ptr<TrigramIndex> index (search_index_);
+
+    if (index.get())
+    {
+      {
+        ScopedTimer timer (STATS_INDEX);
+        index->load();
+      }
+      find_data.index = index.get();
+
+      // Without any literals to look up, the index can't rule out any
+      // files.  It is still brought up-to-date though.
+      std::vector<std::string> literals;
+      bool caseless = false;
 
+      if (get_required_literals(pattern, literals, caseless))
+        TrigramIndex::get_literal_trigrams(literals, find_data.index_query);
+    }
+
+    // Set up a job for every file.  The files are loaded and scanned on the
+    // worker threads of the search pool, but the results are merged strictly
+    // in tree order, so that the outcome is the same as if the files had
+    // been searched one after another.
     treestore_->foreach(sigc::bind(
         sigc::mem_fun(*this, &FileTree::find_matches_at_path_iter),
         sigc::ref(find_data)));
+
+    typedef std::list<FindMatchesJob>::iterator JobIterator;
+
+    JobIterator  pqueue = find_data.jobs.begin();
+    unsigned int queued = 0;
+
+    while (!find_data.jobs.empty())
+    {
+      // No more than queue_depth jobs are in flight at once, so that the
+      // loaded files waiting to be merged don't pile up in memory.
+      for (; pqueue != find_data.jobs.end() && queued < find_data.queue_depth; ++pqueue)
+      {
+        if (!pqueue->job.done)
+        {
+          find_matches_queue(*pqueue, find_data);
+          ++queued;
+        }
+      }
+
+      FindMatchesJob& entry = find_data.jobs.front();
+
+      if (!find_matches_wait(entry, find_data))
+        break; // cancelled
+
+      if (entry.queued)
+        --queued;
+
+      find_matches_merge(entry, find_data);
+
+      // Release the text and match list as early as possible.
+      find_data.jobs.pop_front();
+    }
+
+    if (find_data.jobs.empty())
+    {
+      last_pattern_  = pattern;
+      last_multiple_ = multiple;
+    }
+
+    if (index.get())
+    {
+      ScopedTimer timer (STATS_INDEX);
+      index->save();
+
+      // Put it back, unless the settings have changed in the meantime.
+      if (index->get_fallback_encoding() == fallback_encoding_
+          && Settings::instance()->get_boolean(conf_key_use_search_index))
+        search_index_ = index;
+    }
   }
 
   signal_bound_state_changed(); // emit
@@ -243,14 +394,19 @@ long FileTree::get_match_count() const
   return sum_matches_;
 }
 
-void FileTree::replace_all_matches(const Glib::ustring& substitution)
+void FileTree::replace_all_matches(const Glib::ustring& substitution, ProgressReporter& progress)
 {
   {
     Util::ScopedBlock block_match_count      (conn_match_count_);
     Util::ScopedBlock block_modified_changed (conn_modified_changed_);
     Util::ScopedBlock block_undo_stack_push  (conn_undo_stack_push_);
     ScopedBlockSorting block_sort   (*this);
-    ReplaceMatchesData replace_data (*this, substitution);
+    ReplaceMatchesData replace_data (*this, substitution, progress);
+
+    // Sum up the work in advance, so that the progress is known.
+    treestore_->foreach_iter(sigc::bind(
+        sigc::mem_fun(*this, &FileTree::replace_matches_count_at_iter),
+        sigc::ref(progress)));
 
     treestore_->foreach(sigc::bind(
         sigc::mem_fun(*this, &FileTree::replace_matches_at_path_iter),
@@ -351,145 +507,151 @@ bool FileTree::select_func(const Glib::RefPtr<Gtk::TreeModel>& model,
   return (get_fileinfo_from_iter(model->get_iter(path)) != 0);
 }
 
-void FileTree::find_recursively(const std::string& dirname, FindData& find_data)
+/*
+ * Fill the tree with all files found at once.  The rows are inserted in
+ * the order of the default sort function, so the model is detached from
+ * the view and sorting is turned off meanwhile.  Otherwise every single
+ * insertion would cause a lookup of the sort position as well as a round
+ * of view updates.
+ */
+void FileTree::find_add_files(WalkEntryList& entries, FindData& find_data)
 {
-  using namespace Glib;
+  ScopedTimer timer (STATS_TREE);
 
-  try
-  {
-    int file_count = 0;
-    Dir dir (dirname);
+  sort_walk_entries(find_data.toplevel, entries);
 
-    for (Dir::iterator pos = dir.begin(); pos != dir.end(); ++pos)
-    {
-      if (signal_pulse()) // emit
-        break;
+  int           sort_column = Gtk::TreeSortable::DEFAULT_SORT_COLUMN_ID;
+  Gtk::SortType sort_order  = Gtk::SORT_ASCENDING;
 
-      const std::string filename = *pos;
+  treestore_->get_sort_column_id(sort_column, sort_order);
 
-      if (!find_data.hidden && *filename.begin() == '.')
-        continue;
+  unset_model();
+  treestore_->set_sort_column(Gtk::TreeSortable::DEFAULT_UNSORTED_COLUMN_ID, sort_order);
 
-      const std::string fullname = build_filename(dirname, filename);
+  WalkEntryList::const_iterator pbegin = entries.begin();
 
-      if (file_test(fullname, FILE_TEST_IS_SYMLINK))
-        continue; // ignore symbolic links
+  while (pbegin != entries.end())
+  {
+    // After sorting, the files of a directory are adjacent, so that the
+    // directory node can be looked up once for a whole run of files.
+    WalkEntryList::const_iterator pend = pbegin;
 
-      if (find_data.recursive && file_test(fullname, FILE_TEST_IS_DIR))
-      {
-        // Put the directory name on the stack instead of creating a new node
-        // immediately.  The corresponding node will be created on demand if
-        // there's actually a matching file in the directory or one of its
-        // subdirectories.
-        ScopedPushDir pushdir (find_data.dirstack, fullname);
-        find_recursively(fullname, find_data); // recurse
-      }
-      else if (file_test(fullname, FILE_TEST_IS_REGULAR))
-      {
-        const ustring basename = Glib::filename_display_basename(fullname);
+    while (pend != entries.end() && pend->dirname == pbegin->dirname)
+      ++pend;
 
-        if (find_data.pattern->match(basename))
-        {
-          find_add_file(basename, fullname, find_data);
-          ++file_count;
-        }
-      }
-    }
+    const Gtk::TreeModel::iterator dirnode = find_get_dirnode(pbegin->dirname, find_data);
 
-    find_increment_file_count(find_data, file_count);
-  }
-  catch (const FileError& error)
-  {
-    // Collect errors but don't interrupt the search.
-    find_data.error_list->push_back(error.what());
+    for (WalkEntryList::const_iterator p = pbegin; p != pend; ++p)
+      find_add_file(*p, dirnode);
+
+    find_increment_file_count(dirnode, pend - pbegin);
+    pbegin = pend;
   }
+
+  // Setting a sort column makes GtkTreeStore sort the whole tree again,
+  // even if it is in order already.  So the model is left unsorted until
+  // the user picks a column, unless another column was picked before.
+  const bool is_default_order = (sort_order == Gtk::SORT_ASCENDING
+      && (sort_column == Gtk::TreeSortable::DEFAULT_SORT_COLUMN_ID
+          || sort_column == Gtk::TreeSortable::DEFAULT_UNSORTED_COLUMN_ID));
+
+  if (!is_default_order)
+    treestore_->set_sort_column(sort_column, sort_order);
+
+  set_model(treestore_);
+
+  toplevel_.file_count = entries.size();
+  signal_file_count_changed(); // emit
 }
 
-void FileTree::find_add_file(const Glib::ustring& basename, const std::string& fullname,
-                             FindData& find_data)
+void FileTree::find_add_file(const WalkEntry& entry, const Gtk::TreeModel::iterator& dirnode)
 {
-  // Build the collate key with a leading '1' so that directories always
-  // come first (they have a leading '0').  This is simpler and faster
-  // than explicitely checking for directories in the sort function.
-  std::string collate_key (1, '1');
-  collate_key += basename.collate_key();
+  const FileInfoPtr fileinfo (new FileInfo(entry.fullname));
 
-  const FileInfoBasePtr fileinfo (new FileInfo(fullname));
+  fileinfo->size = entry.size;
 
   Gtk::TreeModel::Row row;
 
-  if (find_data.dirstack.empty())
-  {
-    row = *treestore_->prepend(); // new toplevel node
-  }
+  if (!dirnode)
+    row = *treestore_->append(); // new toplevel node
   else
-  {
-    if (!find_data.dirstack.back().second)
-      find_fill_dirstack(find_data); // build all directory nodes in the stack
-
-    row = *treestore_->prepend(find_data.dirstack.back().second->children());
-  }
+    row = *treestore_->append(dirnode->children());
 
   const FileTreeColumns& columns = FileTreeColumns::instance();
 
-  row[columns.filename]   = basename;
-  row[columns.collatekey] = collate_key;
-  row[columns.fileinfo]   = fileinfo;
+  // The collate key already has a leading '1' so that directories always
+  // come first (they have a leading '0').  This is simpler and faster
+  // than explicitely checking for directories in the sort function.
+  row[columns.filename]   = entry.basename;
+  row[columns.collatekey] = entry.collate_key;
+  row[columns.fileinfo]   = FileInfoBasePtr(fileinfo);
 }
 
-void FileTree::find_fill_dirstack(FindData& find_data)
+/*
+ * Return the node of the directory, which is created on demand together
+ * with the nodes of all its parent directories, since only directories
+ * that actually contain matching files show up in the tree.  The toplevel
+ * directory itself isn't represented by a node, which is indicated by
+ * returning an invalid iterator.
+ */
+Gtk::TreeModel::iterator FileTree::find_get_dirnode(const std::string& dirname,
+                                                    FindData& find_data)
 {
-  const FileTreeColumns& columns = FileTreeColumns::instance();
+  if (dirname == find_data.toplevel)
+    return Gtk::TreeModel::iterator();
 
-  const DirStack::iterator pend  = find_data.dirstack.end();
-  DirStack::iterator       pprev = pend;
+  const DirNodeMap::const_iterator pos = find_data.dirnodes.find(dirname);
 
-  for (DirStack::iterator pdir = find_data.dirstack.begin(); pdir != pend; pprev = pdir++)
-  {
-    if (pdir->second) // node already created
-      continue;
+  if (pos != find_data.dirnodes.end())
+    return pos->second;
 
-    const Glib::ustring dirname = Glib::filename_display_basename(pdir->first);
+  const std::string parent_dirname = Glib::path_get_dirname(dirname);
 
-    // Build the collate key with a leading '0' so that directories always
-    // come first.  This is simpler and faster than explicitely checking for
-    // directories in the sort function.
-    std::string collate_key (1, '0');
-    collate_key += dirname.collate_key();
+  // Just a safeguard against infinite recursion.
+  g_return_val_if_fail(parent_dirname.size() < dirname.size(), Gtk::TreeModel::iterator());
 
-    const FileInfoBasePtr dirinfo (new DirInfo());
+  const Gtk::TreeModel::iterator parent = find_get_dirnode(parent_dirname, find_data); // recurse
 
-    if (pprev == pend)
-      pdir->second = treestore_->prepend(); // new toplevel node
-    else
-      pdir->second = treestore_->prepend(pprev->second->children());
+  const Glib::ustring basename = Glib::filename_display_basename(dirname);
 
-    Gtk::TreeModel::Row row = *pdir->second;
+  // Build the collate key with a leading '0' so that directories always
+  // come first.  This is simpler and faster than explicitely checking for
+  // directories in the sort function.
+  std::string collate_key (1, '0');
+  collate_key += basename.collate_key();
 
-    row[columns.filename]   = dirname;
-    row[columns.collatekey] = collate_key;
-    row[columns.fileinfo]   = dirinfo;
-  }
+  const FileInfoBasePtr dirinfo (new DirInfo());
+
+  // The files are added in tree order, therefore all subdirectories and
+  // files that precede this directory have already been appended.
+  const Gtk::TreeModel::iterator dirnode = (parent) ? treestore_->append(parent->children())
+                                                    : treestore_->append(); // toplevel node
+  const FileTreeColumns& columns = FileTreeColumns::instance();
+
+  Gtk::TreeModel::Row row = *dirnode;
+
+  row[columns.filename]   = basename;
+  row[columns.collatekey] = collate_key;
+  row[columns.fileinfo]   = dirinfo;
+
+  find_data.dirnodes.insert(DirNodeMap::value_type(dirname, dirnode));
+
+  return dirnode;
 }
 
-void FileTree::find_increment_file_count(FindData& find_data, int file_count)
+void FileTree::find_increment_file_count(const Gtk::TreeModel::iterator& dirnode,
+                                         int file_count)
 {
   if (file_count <= 0)
     return;
 
   const FileTreeColumns& columns = FileTreeColumns::instance();
 
-  const DirStack::iterator pbegin = find_data.dirstack.begin();
-  DirStack::iterator       pdir   = find_data.dirstack.end();
-
-  while (pdir != pbegin)
+  for (Gtk::TreeModel::iterator pdir = dirnode; pdir; pdir = pdir->parent())
   {
-    const FileInfoBasePtr base = (*(--pdir)->second)[columns.fileinfo];
+    const FileInfoBasePtr base = (*pdir)[columns.fileinfo];
     shared_polymorphic_cast<DirInfo>(base)->file_count += file_count;
   }
-
-  toplevel_.file_count += file_count;
-  signal_file_count_changed(); // emit
 }
 
 bool FileTree::save_file_at_iter(const Gtk::TreeModel::iterator& iter,
@@ -505,78 +667,278 @@ bool FileTree::save_file_at_iter(const Gtk::TreeModel::iterator& iter,
     }
     catch (const Glib::Error& error)
     {
-      error_list->push_back(Util::compose(_("Failed to save file \342\200\234%1\342\200\235: %2"),
-                                          Glib::filename_display_basename(fileinfo->fullname),
-                                          error.what()));
+      error_list->push_back(compose_save_error(fileinfo->fullname, error.what()));
     }
 
-    if (!fileinfo->buffer->get_modified())
-      propagate_modified_change(iter, false);
+    save_file_done(iter, fileinfo);
+  }
+
+  return false;
+}
+
+bool FileTree::save_files_at_iter(const Gtk::TreeModel::iterator& iter,
+                                  SaveFilesData& save_data)
+{
+  const FileInfoPtr fileinfo = get_fileinfo_from_iter(iter);
+
+  if (fileinfo && fileinfo->buffer && fileinfo->buffer->get_modified())
+  {
+    if (save_data.jobs.size() >= save_data.queue_depth)
+      save_files_finish(save_data);
+
+    save_data.jobs.push_back(SaveFilesJob(iter, fileinfo));
+
+    SaveJob& job = save_data.jobs.back().job;
 
-    if (fileinfo != last_selected_ && fileinfo->buffer->is_freeable())
-      Glib::RefPtr<FileBuffer>().swap(fileinfo->buffer); // reduce memory footprint
+    job.fullname = fileinfo->fullname;
+    job.encoding = fileinfo->encoding;
+    job.text     = fileinfo->buffer->get_text().raw();
+
+    save_data.pool.push(job);
   }
 
   return false;
 }
 
+/*
+ * Wait for the oldest job in the queue, and take over its result.
+ */
+void FileTree::save_files_finish(SaveFilesData& save_data)
+{
+  SaveFilesJob& entry = save_data.jobs.front();
+
+  save_data.pool.wait(entry.job);
+
+  if (entry.job.error.empty())
+    entry.fileinfo->buffer->set_modified(false);
+  else
+    save_data.error_list->push_back(compose_save_error(entry.fileinfo->fullname, entry.job.error));
+
+  save_file_done(entry.iter, entry.fileinfo);
+
+  save_data.jobs.pop_front();
+}
+
+void FileTree::save_file_done(const Gtk::TreeModel::iterator& iter, const FileInfoPtr& fileinfo)
+{
+  if (!fileinfo->buffer->get_modified())
+    propagate_modified_change(iter, false);
+
+  if (fileinfo != last_selected_ && fileinfo->buffer->is_freeable())
+    Glib::RefPtr<FileBuffer>().swap(fileinfo->buffer); // reduce memory footprint
+}
+
 bool FileTree::find_matches_at_path_iter(const Gtk::TreeModel::Path& path,
                                          const Gtk::TreeModel::iterator& iter,
                                          FindMatchesData& find_data)
 {
-  if (signal_pulse()) // emit
-    return true;
-
   if (const FileInfoPtr fileinfo = get_fileinfo_from_iter(iter))
   {
-    if (!fileinfo->buffer)
-      load_file_with_fallback(iter, fileinfo);
-
-    if (fileinfo->load_failed)
+    if (fileinfo->buffer && fileinfo->load_failed)
       return false; // continue
 
-    const Glib::RefPtr<FileBuffer> buffer = fileinfo->buffer;
-    g_assert(buffer);
+    find_data.jobs.push_back(FindMatchesJob(path, iter, fileinfo));
+
+    FindMatchesJob& entry = find_data.jobs.back();
+    entry.job.fullname = fileinfo->fullname;
+
+    if (fileinfo->buffer)
+    {
+      // If the buffer has been searched for the same pattern before, only
+      // the lines edited since have to be scanned again, which is done in
+      // place when merging.  Feedback needs a full scan though.
+      if (signal_feedback.empty()
+          && fileinfo->buffer->can_rescan(find_data.pattern, find_data.multiple))
+      {
+        entry.rescan = true;
+        entry.job.done = true;
+        return false; // continue
+      }
+
+      // The text is only copied once the job is queued.
+    }
+    else
+    {
+      entry.job.load = true;
+
+      const bool have_stamp = (!fileinfo->load_failed
+                               && TrigramIndex::get_file_stamp(fileinfo->fullname, entry.file_stamp));
+
+      // The stamp is more recent than the size recorded when the file
+      // was found.
+      if (have_stamp)
+        fileinfo->size = entry.file_stamp.size;
+
+      entry.job.size = fileinfo->size;
+
+      // A file that didn't match the same search before, and hasn't been
+      // modified since, isn't read again.
+      if (have_stamp && find_data.repeated && fileinfo->search_stamp.is_set()
+          && fileinfo->search_stamp == entry.file_stamp)
+      {
+        entry.job.done = true;
+        return false; // continue
+      }
+
+      // Consult the search index before anything is read.  Files it rules
+      // out are never queued, and the job is merged as if nothing had been
+      // found.  Files it has no current entry for are indexed on the fly.
+      if (find_data.index && have_stamp)
+      {
+        bool may_match = true;
+
+        if (!find_data.index->lookup(fileinfo->fullname, entry.file_stamp,
+                                     find_data.index_query, may_match))
+        {
+          entry.job.index = true;
+        }
+        else if (!may_match)
+        {
+          entry.job.done = true;
+          return false; // continue
+        }
+      }
+    }
 
-    Util::ScopedConnection conn (buffer->signal_pulse.connect(signal_pulse.make_slot()));
+    find_data.progress.add_files_total(1);
+    find_data.progress.add_bytes_total(entry.job.size);
+  }
 
-    const int old_match_count = buffer->get_match_count();
+  return false;
+}
 
-    // Optimize the common case and construct the feedback slot only if there
-    // are actually any handlers connected to the signal.  find_matches() can
-    // then check whether the slot is empty to avoid providing arguments that
-    // are never going to be used.
-    const int new_match_count =
-        buffer->find_matches(find_data.pattern, find_data.multiple, (signal_feedback.empty())
-                             ? sigc::slot<void, int, const Glib::ustring&>()
-                             : sigc::bind(signal_feedback.make_slot(), fileinfo));
+void FileTree::find_matches_queue(FindMatchesJob& entry, FindMatchesData& find_data)
+{
+  if (!entry.job.load)
+  {
+    // The worker threads must not touch the buffer, so hand them a copy.
+    entry.job.text = entry.fileinfo->buffer->get_text().raw();
+    entry.job.size = entry.job.text.size();
+    entry.change_stamp = entry.fileinfo->buffer->get_change_stamp();
+
+    find_data.progress.add_bytes_total(entry.job.size);
+  }
 
-    if (new_match_count > 0)
+  entry.queued = true;
+  find_data.pool.push(entry.job);
+}
+
+/*
+ * Wait for the job to finish while keeping the GUI responsive.
+ * Returns false if the search has been cancelled in the meantime.
+ */
+bool FileTree::find_matches_wait(FindMatchesJob& entry, FindMatchesData& find_data)
+{
+  do
+  {
+    if (find_data.progress.poll())
     {
-      if (!find_data.path_match_first_set)
+      find_data.pool.cancel();
+      return false;
+    }
+  }
+  while (!find_data.pool.wait(entry.job, WAIT_INTERVAL));
+
+  return true;
+}
+
+void FileTree::find_matches_merge(FindMatchesJob& entry, FindMatchesData& find_data)
+{
+  const FileInfoPtr fileinfo = entry.fileinfo;
+  const SearchJob&  job      = entry.job;
+
+  if (job.index && find_data.index && !job.binary && job.error.empty())
+    find_data.index->update(fileinfo->fullname, entry.file_stamp, entry.job.trigrams);
+
+  // If the scan was done on a snapshot of the buffer, it is only valid as
+  // long as the text hasn't been edited while the GUI was waiting for the
+  // result.  The buffer might also have been created or freed meanwhile.
+  bool rescan = false;
+
+  if (!fileinfo->buffer)
+  {
+    if (job.load)
+    {
+      const bool found_nothing = (job.matches.empty() && !job.binary && job.error.empty());
+      fileinfo->search_stamp = (found_nothing) ? entry.file_stamp : FileStamp();
+
+      if (!job.matches.empty() || job.binary || !job.error.empty())
       {
-        find_data.path_match_first_set = true;
-        path_match_first_ = path;
+        load_file_with_fallback(entry.iter, fileinfo, &job);
+      }
+      else if (fileinfo->load_failed)
+      {
+        // The file is readable now, but there is no point in creating a
+        // buffer for it without matches.  Just reset the row's error state.
+        fileinfo->load_failed = false;
+        treestore_->row_changed(entry.path, entry.iter);
       }
+    }
+    else if (!job.matches.empty())
+    {
+      load_file_from_text(fileinfo, job.text, fileinfo->encoding);
+    }
+
+    if (!fileinfo->buffer || fileinfo->load_failed)
+      return; // no matches, so don't bother keeping a buffer
+  }
+  else
+  {
+    if (fileinfo->load_failed)
+      return;
+
+    rescan = (entry.rescan || job.load
+              || fileinfo->buffer->get_change_stamp() != entry.change_stamp);
+  }
+
+  const Glib::RefPtr<FileBuffer> buffer = fileinfo->buffer;
+
+  const int old_match_count = buffer->get_match_count();
 
-      path_match_last_ = path;
+  // Optimize the common case and construct the feedback slot only if there
+  // are actually any handlers connected to the signal.  find_matches() can
+  // then check whether the slot is empty to avoid providing arguments that
+  // are never going to be used.
+  const sigc::slot<void, int, const Glib::ustring&> feedback = (signal_feedback.empty())
+      ? sigc::slot<void, int, const Glib::ustring&>()
+      : sigc::bind(signal_feedback.make_slot(), fileinfo);
+
+  const int new_match_count = (rescan)
+      ? buffer->find_matches(find_data.pattern, find_data.multiple, feedback,
+                             &find_data.progress)
+      : buffer->install_matches(find_data.pattern, find_data.multiple,
+                                job.text, job.matches, feedback, &find_data.progress);
+
+  // The worker threads only account for the matches they found themselves.
+  if (entry.rescan)
+    find_data.progress.add_matches(new_match_count);
+
+  if (new_match_count > 0)
+  {
+    if (!find_data.path_match_first_set)
+    {
+      find_data.path_match_first_set = true;
+      path_match_first_ = entry.path;
     }
 
-    if (new_match_count != old_match_count)
-      propagate_match_count_change(iter, new_match_count - old_match_count);
+    path_match_last_ = entry.path;
+  }
 
-    if (fileinfo != last_selected_ && buffer->is_freeable())
-      Glib::RefPtr<FileBuffer>().swap(fileinfo->buffer); // reduce memory footprint
+  if (new_match_count != old_match_count)
+  {
+    ScopedTimer timer (STATS_TREE);
+    propagate_match_count_change(entry.iter, new_match_count - old_match_count);
   }
 
-  return false;
+  if (fileinfo != last_selected_ && buffer->is_freeable())
+    Glib::RefPtr<FileBuffer>().swap(fileinfo->buffer); // reduce memory footprint
 }
 
 bool FileTree::replace_matches_at_path_iter(const Gtk::TreeModel::Path& path,
                                             const Gtk::TreeModel::iterator& iter,
                                             ReplaceMatchesData& replace_data)
 {
-  if (signal_pulse()) // emit
+  if (replace_data.progress.poll())
     return true;
 
   const FileInfoPtr fileinfo = get_fileinfo_from_iter(iter);
@@ -603,11 +965,10 @@ bool FileTree::replace_matches_at_path_iter(const Gtk::TreeModel::Path& path,
         // a single user action object for all replacements in all buffers.
         // Note that the caller must block conn_undo_stack_push_ to avoid
         // double notification.
-        Util::ScopedConnection conn1 (buffer->signal_undo_stack_push
-                                        .connect(replace_data.slot_undo_stack_push));
-        Util::ScopedConnection conn2 (buffer->signal_pulse.connect(signal_pulse.make_slot()));
+        Util::ScopedConnection conn (buffer->signal_undo_stack_push
+                                       .connect(replace_data.slot_undo_stack_push));
 
-        buffer->replace_all_matches(replace_data.substitution);
+        buffer->replace_all_matches(replace_data.substitution, &replace_data.progress);
       }
 
       const bool is_modified = buffer->get_modified();
@@ -616,12 +977,29 @@ bool FileTree::replace_matches_at_path_iter(const Gtk::TreeModel::Path& path,
         propagate_modified_change(iter, is_modified);
 
       propagate_match_count_change(iter, buffer->get_match_count() - match_count);
+
+      // The buffer has accounted for the bytes and matches already.
+      replace_data.progress.add_files_done(1);
     }
   }
 
   return false;
 }
 
+bool FileTree::replace_matches_count_at_iter(const Gtk::TreeModel::iterator& iter,
+                                             ProgressReporter& progress)
+{
+  const FileInfoPtr fileinfo = get_fileinfo_from_iter(iter);
+
+  if (fileinfo && fileinfo->buffer && fileinfo->buffer->get_match_count() > 0)
+  {
+    progress.add_files_total(1);
+    progress.add_bytes_total(fileinfo->size);
+  }
+
+  return false;
+}
+
 void FileTree::expand_and_select(const Gtk::TreeModel::Path& path)
 {
   expand_to_path(path);
@@ -899,8 +1277,12 @@ void FileTree::propagate_modified_change(const Gtk::TreeModel::iterator& pos, bo
   signal_modified_count_changed(); // emit
 }
 
+/*
+ * If job is given, the file has already been read by a SearchJob, and the
+ * buffer is created from its text rather than by reading the file again.
+ */
 void FileTree::load_file_with_fallback(const Gtk::TreeModel::iterator& iter,
-                                       const FileInfoPtr& fileinfo)
+                                       const FileInfoPtr& fileinfo, const SearchJob* job)
 {
   g_return_if_fail(!fileinfo->buffer);
 
@@ -908,15 +1290,26 @@ void FileTree::load_file_with_fallback(const Gtk::TreeModel::iterator& iter,
 
   try
   {
-    load_file(fileinfo, fallback_encoding_);
+    if (job)
+    {
+      job->check_loaded();
+      load_file_from_text(fileinfo, job->text, job->encoding);
+    }
+    else
+    {
+      load_file(fileinfo, fallback_encoding_);
+    }
   }
   catch (const Glib::Error& error)
   {
+    fileinfo->load_failed = true;
     fileinfo->buffer = FileBuffer::create_with_error_message(
         render_icon_pixbuf(Gtk::Stock::DIALOG_ERROR, Gtk::ICON_SIZE_DIALOG), error.what());
   }
   catch (const ErrorBinaryFile&)
   {
+    fileinfo->load_failed = true;
+
     const Glib::ustring filename = (*iter)[FileTreeColumns::instance().filename];
 
     fileinfo->buffer = FileBuffer::create_with_error_message(
@@ -935,7 +1328,16 @@ void FileTree::load_file_with_fallback(const Gtk::TreeModel::iterator& iter,
 void FileTree::on_conf_value_changed(const Glib::ustring& key)
 {
   if (key == conf_key_fallback_encoding)
+  {
     fallback_encoding_ = Settings::instance()->get_string(key);
+
+    // Files skipped so far might be readable with the new encoding, and
+    // those read with the old one might have different trigrams now.
+    last_pattern_.reset();
+    search_index_.reset();
+  }
+  else if (key == conf_key_use_search_index && !Settings::instance()->get_boolean(key))
+    search_index_.reset();
 }
 
 } // namespace Regexxer
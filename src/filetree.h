@@ -21,8 +21,10 @@
 #ifndef REGEXXER_FILETREE_H_INCLUDED
 #define REGEXXER_FILETREE_H_INCLUDED
 
+#include "dirwalk.h"
 #include "filebuffer.h"
 #include "fileio.h"
+#include "progress.h"
 #include "signalutils.h"
 #include "undostack.h"
 
@@ -31,6 +33,7 @@
 #include <gtkmm/treemodel.h>
 #include <gtkmm/treeview.h>
 #include <list>
+#include <memory>
 
 namespace Gtk   { class TreeStore; }
 namespace Glib  { class Regex; }
@@ -38,6 +41,9 @@ namespace Glib  { class Regex; }
 namespace Regexxer
 {
 
+struct SearchJob;
+class  TrigramIndex;
+
 class FileTree : public Gtk::TreeView
 {
 public:
@@ -46,8 +52,12 @@ public:
   FileTree();
   virtual ~FileTree();
 
+  // The lengthy operations take a progress reporter, which they keep
+  // up-to-date and poll to keep the GUI responsive.  Cancelling it stops
+  // the operation, keeping whatever has been done so far.
+
   void find_files(const std::string& dirname, const Glib::RefPtr<Glib::Regex>& pattern,
-                  bool recursive, bool hidden);
+                  bool recursive, bool hidden, ProgressReporter& progress);
 
   int  get_file_count() const;
 
@@ -59,9 +69,10 @@ public:
 
   BoundState get_bound_state();
 
-  void find_matches(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple);
+  void find_matches(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                    ProgressReporter& progress);
   long get_match_count() const;
-  void replace_all_matches(const Glib::ustring& substitution);
+  void replace_all_matches(const Glib::ustring& substitution, ProgressReporter& progress);
 
   int get_modified_count() const;
 
@@ -70,7 +81,6 @@ public:
   sigc::signal<void>                    signal_file_count_changed;
   sigc::signal<void>                    signal_match_count_changed;
   sigc::signal<void>                    signal_modified_count_changed;
-  sigc::signal<bool>                    signal_pulse;
   sigc::signal<void, UndoActionPtr>     signal_undo_stack_push;
 
   // Provide line number, subject and file info for match location output.
@@ -85,7 +95,10 @@ private:
   class  ScopedBlockSorting;
   class  BufferActionShell;
   struct FindData;
+  struct FindMatchesJob;
   struct FindMatchesData;
+  struct SaveFilesJob;
+  struct SaveFilesData;
   struct ReplaceMatchesData;
 
   typedef Util::SharedPtr<TreeRowRef>        TreeRowRefPtr;
@@ -114,6 +127,10 @@ private:
   Gtk::TreeModel::Path          path_match_last_;
 
   std::string                   fallback_encoding_;
+  std::auto_ptr<TrigramIndex>   search_index_;
+
+  Glib::RefPtr<Glib::Regex>     last_pattern_; // of the last complete search
+  bool                          last_multiple_;
 
   void icon_cell_data_func(Gtk::CellRenderer* cell, const Gtk::TreeModel::iterator& iter);
   void text_cell_data_func(Gtk::CellRenderer* cell, const Gtk::TreeModel::iterator& iter);
@@ -121,22 +138,29 @@ private:
   static bool select_func(const Glib::RefPtr<Gtk::TreeModel>& model,
                           const Gtk::TreeModel::Path& path, bool currently_selected);
 
-  void find_recursively(const std::string& dirname, FindData& find_data);
-  void find_add_file(const Glib::ustring& basename, const std::string& fullname,
-                     FindData& find_data);
-  void find_fill_dirstack(FindData& find_data);
-  void find_increment_file_count(FindData& find_data, int file_count);
+  void find_add_files(WalkEntryList& entries, FindData& find_data);
+  void find_add_file(const WalkEntry& entry, const Gtk::TreeModel::iterator& dirnode);
+  Gtk::TreeModel::iterator find_get_dirnode(const std::string& dirname, FindData& find_data);
+  void find_increment_file_count(const Gtk::TreeModel::iterator& dirnode, int file_count);
 
   bool save_file_at_iter(const Gtk::TreeModel::iterator& iter,
                          const Util::SharedPtr<MessageList>& error_list);
+  bool save_files_at_iter(const Gtk::TreeModel::iterator& iter, SaveFilesData& save_data);
+  void save_files_finish(SaveFilesData& save_data);
+  void save_file_done(const Gtk::TreeModel::iterator& iter, const FileInfoPtr& fileinfo);
 
   bool find_matches_at_path_iter(const Gtk::TreeModel::Path& path,
                                  const Gtk::TreeModel::iterator& iter,
                                  FindMatchesData& find_data);
+  void find_matches_queue(FindMatchesJob& entry, FindMatchesData& find_data);
+  bool find_matches_wait(FindMatchesJob& entry, FindMatchesData& find_data);
+  void find_matches_merge(FindMatchesJob& entry, FindMatchesData& find_data);
 
   bool replace_matches_at_path_iter(const Gtk::TreeModel::Path& path,
                                     const Gtk::TreeModel::iterator& iter,
                                     ReplaceMatchesData& replace_data);
+  bool replace_matches_count_at_iter(const Gtk::TreeModel::iterator& iter,
+                                     ProgressReporter& progress);
 
   void expand_and_select(const Gtk::TreeModel::Path& path);
 
@@ -152,7 +176,8 @@ private:
   void propagate_match_count_change(const Gtk::TreeModel::iterator& pos, int difference);
   void propagate_modified_change(const Gtk::TreeModel::iterator& pos, bool modified);
 
-  void load_file_with_fallback(const Gtk::TreeModel::iterator& iter, const FileInfoPtr& fileinfo);
+  void load_file_with_fallback(const Gtk::TreeModel::iterator& iter, const FileInfoPtr& fileinfo,
+                               const SearchJob* job = 0);
 
   void on_conf_value_changed(const Glib::ustring& key);
 };
@@ -19,9 +19,11 @@
  */
 
 #include "filetreeprivate.h"
+#include "miscutils.h"
 
 #include <glib.h>
 #include <gtkmm/treestore.h>
+#include <algorithm>
 
 namespace Regexxer
 {
@@ -192,34 +194,91 @@ const std::list<Glib::ustring>& FileTree::Error::get_error_list() const
 
 /**** Regexxer::FileTree::FindData *****************************************/
 
-FileTree::FindData::FindData(const Glib::RefPtr<Glib::Regex>& pattern_,
-                             bool recursive_, bool hidden_)
+FileTree::FindData::FindData(const std::string& toplevel_)
 :
-  pattern    (pattern_),
-  recursive  (recursive_),
-  hidden     (hidden_),
+  toplevel   (toplevel_),
+  dirnodes   (),
   error_list (new FileTree::MessageList())
 {}
 
 FileTree::FindData::~FindData()
 {}
 
+/**** Regexxer::FileTree::FindMatchesJob ***********************************/
+
+FileTree::FindMatchesJob::FindMatchesJob(const Gtk::TreeModel::Path& path_,
+                                         const Gtk::TreeModel::iterator& iter_,
+                                         const FileInfoPtr& fileinfo_)
+:
+  path         (path_),
+  iter         (iter_),
+  fileinfo     (fileinfo_),
+  change_stamp (0),
+  file_stamp   (),
+  rescan       (false),
+  queued       (false),
+  job          ()
+{}
+
+FileTree::FindMatchesJob::~FindMatchesJob()
+{}
+
 /**** Regexxer::FileTree::FindMatchesData **********************************/
 
 FileTree::FindMatchesData::FindMatchesData(const Glib::RefPtr<Glib::Regex>& pattern_,
-                                           bool multiple_)
+                                           bool multiple_,
+                                           const std::string& fallback_encoding,
+                                           ProgressReporter& progress_)
 :
+  progress             (progress_),
+  queue_depth          (4 * Util::get_processor_count()),
   pattern              (pattern_),
   multiple             (multiple_),
-  path_match_first_set (false)
+  repeated             (false),
+  path_match_first_set (false),
+  index                (0),
+  index_query          (),
+  jobs                 (),
+  pool                 (pattern_, multiple_, fallback_encoding, progress_)
+{}
+
+FileTree::FindMatchesData::~FindMatchesData()
+{}
+
+/**** Regexxer::FileTree::SaveFilesJob *************************************/
+
+FileTree::SaveFilesJob::SaveFilesJob(const Gtk::TreeModel::iterator& iter_,
+                                     const FileInfoPtr& fileinfo_)
+:
+  iter     (iter_),
+  fileinfo (fileinfo_),
+  job      ()
+{}
+
+FileTree::SaveFilesJob::~SaveFilesJob()
+{}
+
+/**** Regexxer::FileTree::SaveFilesData ************************************/
+
+FileTree::SaveFilesData::SaveFilesData(int queue_depth_)
+:
+  queue_depth (std::max(1, queue_depth_)),
+  error_list  (new FileTree::MessageList()),
+  jobs        (),
+  pool        (queue_depth)
+{}
+
+FileTree::SaveFilesData::~SaveFilesData()
 {}
 
 /**** Regexxer::FileTree::ReplaceMatchesData *******************************/
 
 FileTree::ReplaceMatchesData::ReplaceMatchesData(FileTree& filetree_,
-                                                 const Glib::ustring& substitution_)
+                                                 const Glib::ustring& substitution_,
+                                                 ProgressReporter& progress_)
 :
   filetree             (filetree_),
+  progress             (progress_),
   substitution         (substitution_),
   undo_stack           (new UndoStack()),
   slot_undo_stack_push (sigc::mem_fun(*this, &FileTree::ReplaceMatchesData::undo_stack_push))
@@ -22,9 +22,12 @@
 #define REGEXXER_FILETREEPRIVATE_H_INCLUDED
 
 #include "filetree.h"
+#include "savepool.h"
+#include "searchpool.h"
 
 #include <gtkmm/treerowreference.h>
 #include <gtkmm/treestore.h>
+#include <map>
 #include <utility>
 
 namespace Regexxer
@@ -68,24 +71,7 @@ int collatekey_sort_func(const Gtk::TreeModel::iterator& a, const Gtk::TreeModel
 bool next_match_file(Gtk::TreeModel::iterator& iter, Gtk::TreeModel::Path* collapse = 0);
 bool prev_match_file(Gtk::TreeModel::iterator& iter, Gtk::TreeModel::Path* collapse = 0);
 
-typedef std::pair<std::string, Gtk::TreeModel::iterator> DirNodePair;
-typedef std::list<DirNodePair>                           DirStack;
-
-class ScopedPushDir
-{
-private:
-  DirStack& dirstack_;
-
-  ScopedPushDir(const ScopedPushDir&);
-  ScopedPushDir& operator=(const ScopedPushDir&);
-
-public:
-  ScopedPushDir(DirStack& dirstack, const std::string& dirname)
-    : dirstack_ (dirstack)
-    { dirstack_.push_back(DirNodePair(dirname, Gtk::TreeModel::iterator())); }
-
-  ~ScopedPushDir() { dirstack_.pop_back(); }
-};
+typedef std::map<std::string, Gtk::TreeModel::iterator> DirNodeMap;
 
 } // namespace FileTreePrivate
 
@@ -117,13 +103,11 @@ private:
 
 struct FileTree::FindData
 {
-  FindData(const Glib::RefPtr<Glib::Regex>& pattern_, bool recursive_, bool hidden_);
+  explicit FindData(const std::string& toplevel_);
   ~FindData();
 
-  const Glib::RefPtr<Glib::Regex>&        pattern;
-  const bool                              recursive;
-  const bool                              hidden;
-  FileTreePrivate::DirStack               dirstack;
+  const std::string                       toplevel;
+  FileTreePrivate::DirNodeMap             dirnodes;
   Util::SharedPtr<FileTree::MessageList>  error_list;
 
 private:
@@ -131,25 +115,82 @@ private:
   FileTree::FindData& operator=(const FileTree::FindData&);
 };
 
-struct FileTree::FindMatchesData
+/*
+ * A SearchJob together with what's needed to merge its result back into
+ * the tree.  If the file already had a buffer when the job was queued,
+ * change_stamp records its state at the time the text snapshot was taken.
+ */
+struct FileTree::FindMatchesJob
 {
-  FindMatchesData(const Glib::RefPtr<Glib::Regex>& pattern_, bool multiple_);
+  FindMatchesJob(const Gtk::TreeModel::Path& path_, const Gtk::TreeModel::iterator& iter_,
+                 const FileInfoPtr& fileinfo_);
+  ~FindMatchesJob();
+
+  Gtk::TreeModel::Path      path;
+  Gtk::TreeModel::iterator  iter;
+  FileInfoPtr               fileinfo;
+  unsigned long             change_stamp;
+  FileStamp                 file_stamp;
+  bool                      rescan;     // update the buffer's matches in place
+  bool                      queued;     // pushed to the search pool
+  SearchJob                 job;
+};
 
-  const Glib::RefPtr<Glib::Regex>& pattern;
-  const bool                       multiple;
-  bool                             path_match_first_set;
+struct FileTree::FindMatchesData
+{
+  FindMatchesData(const Glib::RefPtr<Glib::Regex>& pattern_, bool multiple_,
+                  const std::string& fallback_encoding, ProgressReporter& progress_);
+  ~FindMatchesData();
+
+  ProgressReporter&                     progress;
+  const unsigned int                    queue_depth;
+  const Glib::RefPtr<Glib::Regex>&      pattern;
+  const bool                            multiple;
+  bool                                  repeated; // same search as last time
+  bool                                  path_match_first_set;
+  TrigramIndex*                         index;
+  TrigramSet                            index_query;
+  std::list<FileTree::FindMatchesJob>   jobs;
+  SearchPool                            pool; // destroyed before the jobs
 
 private:
   FindMatchesData(const FileTree::FindMatchesData&);
   FileTree::FindMatchesData& operator=(const FileTree::FindMatchesData&);
 };
 
+struct FileTree::SaveFilesJob
+{
+  SaveFilesJob(const Gtk::TreeModel::iterator& iter_, const FileInfoPtr& fileinfo_);
+  ~SaveFilesJob();
+
+  Gtk::TreeModel::iterator  iter;
+  FileInfoPtr               fileinfo;
+  SaveJob                   job;
+};
+
+struct FileTree::SaveFilesData
+{
+  explicit SaveFilesData(int queue_depth_);
+  ~SaveFilesData();
+
+  const unsigned int                      queue_depth;
+  Util::SharedPtr<FileTree::MessageList>  error_list;
+  std::list<FileTree::SaveFilesJob>       jobs;
+  SavePool                                pool; // destroyed before the jobs
+
+private:
+  SaveFilesData(const FileTree::SaveFilesData&);
+  FileTree::SaveFilesData& operator=(const FileTree::SaveFilesData&);
+};
+
 struct FileTree::ReplaceMatchesData
 {
-  ReplaceMatchesData(FileTree& filetree_, const Glib::ustring& substitution_);
+  ReplaceMatchesData(FileTree& filetree_, const Glib::ustring& substitution_,
+                     ProgressReporter& progress_);
   ~ReplaceMatchesData();
 
   FileTree&                             filetree;
+  ProgressReporter&                     progress;
   const Glib::ustring                   substitution;
   FileTree::TreeRowRefPtr               row_reference;
   UndoStackPtr                          undo_stack;
@@ -40,6 +40,12 @@ const char *const conf_key_fallback_encoding   = "fallback-encoding";
 const char *const conf_key_substitution_patterns = "substitution-patterns";
 const char *const conf_key_regex_patterns      = "regex-patterns";
 const char *const conf_key_files_patterns      = "files-patterns";
+const char *const conf_key_exclude_patterns    = "exclude-patterns";
+const char *const conf_key_use_ignore_files    = "use-ignore-files";
+const char *const conf_key_use_search_index    = "use-search-index";
+const char *const conf_key_optimize_regex      = "optimize-regex";
+const char *const conf_key_save_queue_depth    = "save-queue-depth";
+const char *const conf_key_search_as_you_type  = "search-as-you-type";
 const char *const conf_key_window_width        = "window-width";
 const char *const conf_key_window_height       = "window-height";
 const char *const conf_key_window_position_x   = "window-position-x";
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "ignorerules.h"
+
+#include <glib.h>
+#include <glibmm/miscutils.h>
+#include <cstring>
+#include <fnmatch.h>
+
+namespace
+{
+
+// The ignore files read in each directory, in order of increasing priority.
+const char *const ignore_filenames[] = { ".gitignore", ".ignore" };
+
+enum { IGNORE_FILE_COUNT = G_N_ELEMENTS(ignore_filenames) };
+
+} // anonymous namespace
+
+namespace Regexxer
+{
+
+/**** Regexxer::IgnoreRules ************************************************/
+
+// static
+IgnoreRules* IgnoreRules::load(const std::string& dirname, const IgnoreRules* parent)
+{
+  IgnoreRules* rules = 0;
+
+  for (int i = 0; i < IGNORE_FILE_COUNT; ++i)
+  {
+    const std::string filename = Glib::build_filename(dirname, ignore_filenames[i]);
+
+    char* contents = 0;
+    gsize length   = 0;
+
+    // Use the C API, since a missing ignore file is the normal case
+    // and not worth an exception.
+    if (!g_file_get_contents(filename.c_str(), &contents, &length, 0))
+      continue;
+
+    if (!rules)
+      rules = new IgnoreRules(dirname, parent);
+
+    rules->parse(std::string(contents, length));
+    g_free(contents);
+  }
+
+  if (rules && rules->rules_.empty())
+  {
+    delete rules;
+    rules = 0;
+  }
+
+  return rules;
+}
+
+IgnoreRules::IgnoreRules(const std::string& dirname, const IgnoreRules* parent)
+:
+  parent_  (parent),
+  dirname_ (dirname),
+  rules_   ()
+{}
+
+IgnoreRules::~IgnoreRules()
+{}
+
+// static
+bool IgnoreRules::is_ignore_file(const char* filename)
+{
+  for (int i = 0; i < IGNORE_FILE_COUNT; ++i)
+  {
+    if (std::strcmp(filename, ignore_filenames[i]) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+bool IgnoreRules::is_ignored(const std::string& fullname, bool is_dir) const
+{
+  const std::string::size_type slash = fullname.rfind(G_DIR_SEPARATOR);
+  const char *const basename = fullname.c_str() + ((slash != std::string::npos) ? slash + 1 : 0);
+
+  for (const IgnoreRules* node = this; node; node = node->parent_)
+  {
+    std::string::size_type offset = node->dirname_.size();
+
+    if (fullname.compare(0, offset, node->dirname_) != 0)
+      continue; // shouldn't happen
+
+    if (offset < fullname.size() && fullname[offset] == G_DIR_SEPARATOR)
+      ++offset;
+
+    const char *const relname = fullname.c_str() + offset;
+
+    // The last matching rule decides, so check them in reverse.
+    for (std::vector<Rule>::const_reverse_iterator p = node->rules_.rbegin();
+         p != node->rules_.rend(); ++p)
+    {
+      if (p->dir_only && !is_dir)
+        continue;
+
+      if (fnmatch(p->pattern.c_str(), (p->anchored) ? relname : basename, p->flags) == 0)
+        return !p->negated;
+    }
+  }
+
+  return false;
+}
+
+/**** Regexxer::IgnoreRules -- private *************************************/
+
+/*
+ * Parse the gitignore(5) syntax.  The only simplification concerns "**"
+ * in the middle of a pattern, which is emulated by letting "*" match
+ * across directory separators in that pattern.
+ */
+void IgnoreRules::parse(const std::string& contents)
+{
+  std::string::size_type pos = 0;
+
+  while (pos < contents.size())
+  {
+    std::string::size_type line_end = contents.find('\n', pos);
+
+    if (line_end == std::string::npos)
+      line_end = contents.size();
+
+    std::string line (contents, pos, line_end - pos);
+    pos = line_end + 1;
+
+    // Trailing whitespace is insignificant, including a DOS line terminator.
+    while (!line.empty() && (*line.rbegin() == ' ' || *line.rbegin() == '\r'))
+      line.erase(line.size() - 1);
+
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    Rule rule;
+    rule.flags    = 0;
+    rule.negated  = (line[0] == '!');
+    rule.dir_only = false;
+    rule.anchored = false;
+
+    if (rule.negated)
+      line.erase(0, 1);
+    else if (line[0] == '\\' && line.size() > 1 && (line[1] == '!' || line[1] == '#'))
+      line.erase(0, 1);
+
+    if (!line.empty() && *line.rbegin() == '/')
+    {
+      rule.dir_only = true;
+      line.erase(line.size() - 1);
+    }
+
+    const bool any_depth = (line.compare(0, 3, "**/") == 0);
+
+    if (any_depth)
+    {
+      line.erase(0, 3);
+    }
+    else if (!line.empty() && line[0] == '/')
+    {
+      rule.anchored = true;
+      line.erase(0, 1);
+    }
+
+    if (line.empty())
+      continue;
+
+    if (line.find('/') != std::string::npos)
+      rule.anchored = true;
+
+    if (rule.anchored && line.find("**") == std::string::npos)
+      rule.flags = FNM_PATHNAME;
+
+    if (any_depth && rule.anchored)
+    {
+      // Match directly in this directory, and below any subdirectory.
+      rule.pattern = line;
+      rules_.push_back(rule);
+
+      line.insert(0, "*/");
+      rule.flags = 0;
+    }
+
+    rule.pattern.swap(line);
+    rules_.push_back(rule);
+  }
+}
+
+} // namespace Regexxer
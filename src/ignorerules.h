@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef REGEXXER_IGNORERULES_H_INCLUDED
+#define REGEXXER_IGNORERULES_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+namespace Regexxer
+{
+
+/*
+ * The patterns read from the .gitignore and .ignore files of a directory.
+ * Just like with git, the rules of a directory apply to everything below
+ * it, and take precedence over the rules inherited from the parent.  The
+ * chain of parents is referenced by plain pointers; it is up to the owner
+ * to keep the parents alive for as long as their children are in use.
+ */
+class IgnoreRules
+{
+public:
+  // Load the ignore files of dirname.  Returns 0 if there are no rules,
+  // in which case the parent's rules apply unchanged.
+  static IgnoreRules* load(const std::string& dirname, const IgnoreRules* parent);
+
+  ~IgnoreRules();
+
+  static bool is_ignore_file(const char* filename);
+
+  // Whether the file or directory is excluded by the rules of this
+  // directory or any of its parents.
+  bool is_ignored(const std::string& fullname, bool is_dir) const;
+
+private:
+  struct Rule
+  {
+    std::string pattern;
+    int         flags;    // for fnmatch()
+    bool        negated;
+    bool        dir_only;
+    bool        anchored; // match the relative path instead of the basename
+  };
+
+  const IgnoreRules*  parent_;
+  std::string         dirname_;
+  std::vector<Rule>   rules_;
+
+  IgnoreRules(const std::string& dirname, const IgnoreRules* parent);
+  IgnoreRules(const IgnoreRules&);
+  IgnoreRules& operator=(const IgnoreRules&);
+
+  void parse(const std::string& contents);
+};
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_IGNORERULES_H_INCLUDED */
@@ -18,13 +18,15 @@
  * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include "batch.h"
 #include "globalstrings.h"
 #include "mainwindow.h"
 #include "miscutils.h"
+#include "stats.h"
 #include "translation.h"
 
 #include <glib.h>
-#include <gtk/gtk.h> /* for gtk_window_set_default_icon_name() */
+#include <gtk/gtk.h> /* for gtk_window_set_default_icon_name() and gtk_get_option_group() */
 #include <glibmm.h>
 #include <gtkmm/iconfactory.h>
 #include <gtkmm/iconset.h>
@@ -144,12 +146,20 @@ std::auto_ptr<RegexxerOptions> RegexxerOptions::create()
                   init.no_global);
   group.add_entry(entry("ignore-case", 'i', N_("Do case insensitive matching")),
                   init.ignorecase);
+  group.add_entry(entry("multiline", 'm', N_("Let matches span several lines")),
+                  init.multiline);
   group.add_entry(entry("substitution", 's', N_("Replace matches with STRING"), N_("STRING")),
                   init.substitution);
   group.add_entry(entry("line-number", 'n', N_("Print match location to standard output")),
                   init.feedback);
   group.add_entry(entry("no-autorun", 'A', N_("Do not automatically start search")),
                   init.no_autorun);
+  group.add_entry(entry("batch", 'b', N_("Run without user interface and exit when done")),
+                  init.batch);
+  group.add_entry(entry("in-place", '\0', N_("Replace matches and save the files in batch mode")),
+                  init.in_place);
+  group.add_entry(entry("stats", '\0', N_("Print where the time went to standard error on exit")),
+                  init.stats);
   group.add_entry_filename(entry(G_OPTION_REMAINING, '\0', 0, N_("[FOLDER]")),
                            init.folder);
 
@@ -193,18 +203,52 @@ void register_stock_items()
   factory->add_default();
 }
 
+static
+void print_stats(gint64 start_time)
+{
+  const Glib::ustring report = Regexxer::Stats::format_report(Regexxer::Stats::get_snapshot(),
+                                                              g_get_monotonic_time() - start_time);
+  g_printerr("%s\n", report.c_str());
+}
+
 } // anonymous namespace
 
 int main(int argc, char** argv)
 {
+  const gint64 start_time = g_get_monotonic_time();
+
   try
   {
     Util::initialize_gettext(PACKAGE_TARNAME, REGEXXER_LOCALEDIR);
 
+    if (!Glib::thread_supported())
+      Glib::thread_init();
+
+    Gio::init();
+
     std::auto_ptr<RegexxerOptions> options = RegexxerOptions::create();
-    Gtk::Main main_instance (argc, argv, options->context());
+
+    // Parse the command line before the display is opened, so that the
+    // batch mode works on hosts without an X server.  Still, the GTK+
+    // options have to be known to the parser in order to show up in --help.
+    g_option_context_add_group(options->context().gobj(), gtk_get_option_group(FALSE));
+    options->context().parse(argc, argv);
+
+    const bool stats = options->init_state().stats;
+
+    if (options->init_state().batch)
+    {
+      Regexxer::Batch batch (options->init_state());
+      const int status = batch.run();
+
+      if (stats)
+        print_stats(start_time);
+
+      return status;
+    }
+
+    Gtk::Main main_instance (argc, argv);
     Gsv::init();
-    Gio::init();
 
     Glib::set_application_name(PACKAGE_NAME);
     register_stock_items();
@@ -217,6 +261,9 @@ int main(int argc, char** argv)
 
     Gtk::Main::run(*window.get_window());
 
+    if (stats)
+      print_stats(start_time);
+
     return 0;
   }
   catch (const Glib::OptionError& error)
@@ -19,11 +19,13 @@
  */
 
 #include "mainwindow.h"
+#include "batch.h"
 #include "filetree.h"
 #include "globalstrings.h"
 #include "prefdialog.h"
 #include "statusline.h"
 #include "stringutils.h"
+#include "textscan.h"
 #include "translation.h"
 #include "settings.h"
 
@@ -32,14 +34,21 @@
 #include <gtksourceviewmm.h>
 #include <algorithm>
 #include <functional>
-#include <iostream>
 
 #include <config.h>
 
 namespace
 {
 
-enum { BUSY_GUI_UPDATE_INTERVAL = 16 };
+// Milliseconds between GUI updates during a busy action, which is about
+// 30 frames per second.
+enum { BUSY_FRAME_INTERVAL = 33 };
+
+// Seconds to wait before the throughput and time left are estimated.
+enum { ESTIMATE_MIN_ELAPSED = 1 };
+
+// Milliseconds without a keystroke before a search is run while typing.
+enum { LIVE_SEARCH_DELAY = 300 };
 
 typedef Glib::RefPtr<Regexxer::FileBuffer> FileBufferPtr;
 
@@ -121,16 +130,7 @@ FileErrorDialog::~FileErrorDialog()
 static
 void print_location(int linenumber, const Glib::ustring& subject, Regexxer::FileInfoPtr fileinfo)
 {
-  std::cout << fileinfo->fullname << ':' << linenumber + 1 << ':';
-
-  std::string charset;
-
-  if (Glib::get_charset(charset))
-    std::cout << subject.raw(); // charset is UTF-8
-  else
-    std::cout << Glib::convert_with_fallback(subject.raw(), charset, "UTF-8");
-
-  std::cout << std::endl;
+  Regexxer::print_location(fileinfo->fullname, linenumber, subject);
 }
 
 } // anonymous namespace
@@ -150,8 +150,12 @@ InitState::InitState()
   hidden        (false),
   no_global     (false),
   ignorecase    (false),
+  multiline     (false),
   feedback      (false),
-  no_autorun    (false)
+  no_autorun    (false),
+  batch         (false),
+  in_place      (false),
+  stats         (false)
 {}
 
 InitState::~InitState()
@@ -187,11 +191,13 @@ MainWindow::MainWindow()
   entry_regex_            (0),
   entry_regex_completion_stack_(10, Settings::instance()->get_string_array(conf_key_regex_patterns)),
   entry_regex_completion_ (Gtk::EntryCompletion::create()),
+  regex_cache_            (10), // as many as there are in the history
   entry_substitution_     (0),
   entry_substitution_completion_stack_(10, Settings::instance()->get_string_array(conf_key_substitution_patterns)),
   entry_substitution_completion_ (Gtk::EntryCompletion::create()),
   button_multiple_        (0),
   button_caseless_        (0),
+  button_multiline_       (0),
   filetree_               (Gtk::manage(new FileTree())),
   scrollwin_filetree_     (0),
   scrollwin_textview_     (0),
@@ -199,9 +205,14 @@ MainWindow::MainWindow()
   entry_preview_          (0),
   statusline_             (Gtk::manage(new StatusLine())),
   busy_action_running_    (false),
-  busy_action_cancel_     (false),
-  busy_action_iteration_  (0),
-  undo_stack_             (new UndoStack())
+  progress_               (BUSY_FRAME_INTERVAL),
+  busy_action_frame_      (),
+  busy_action_stats_      (),
+  search_running_         (false),
+  live_search_            (LIVE_SEARCH_DELAY),
+  undo_stack_             (new UndoStack()),
+  buffer_connections_     (),
+  highlight_range_changed_(Glib::PRIORITY_HIGH_IDLE + 15) // before redraw (+20)
 {
   load_xml();
 
@@ -285,6 +296,11 @@ void MainWindow::initialize(const InitState& init)
   button_hidden_   ->set_active(init.hidden);
   button_multiple_ ->set_active(!init.no_global);
   button_caseless_ ->set_active(init.ignorecase);
+  button_multiline_->set_active(init.multiline);
+
+  // Setting up the initial values isn't typing, and the autorun below
+  // takes care of the search if there is to be one.
+  live_search_.cancel();
 
   combo_entry_pattern_->set_entry_text_column(0);
   const std::list<Glib::ustring> patterns =
@@ -336,6 +352,7 @@ void MainWindow::load_xml()
   xml->get_widget("comboboxentry_substitution",  comboboxentry_substitution_);
   xml->get_widget("button_multiple",     button_multiple_);
   xml->get_widget("button_caseless",     button_caseless_);
+  xml->get_widget("button_multiline",    button_multiline_);
   xml->get_widget("scrollwin_textview",  scrollwin_textview_);
   xml->get_widget("entry_preview",       entry_preview_);
   xml->get_widget("vbox_main",           vbox_main_);
@@ -361,6 +378,12 @@ void MainWindow::connect_signals()
   entry_substitution_->signal_activate().connect(controller_.find_matches.slot());
   entry_substitution_->signal_changed ().connect(mem_fun(*this, &MainWindow::update_preview));
 
+  entry_regex_     ->signal_changed().connect(mem_fun(*this, &MainWindow::on_live_search_changed));
+  button_caseless_ ->signal_toggled().connect(mem_fun(*this, &MainWindow::on_live_search_changed));
+  button_multiple_ ->signal_toggled().connect(mem_fun(*this, &MainWindow::on_live_search_changed));
+  button_multiline_->signal_toggled().connect(mem_fun(*this, &MainWindow::on_live_search_changed));
+  live_search_.connect(mem_fun(*this, &MainWindow::on_live_search));
+
   controller_.save_file   .connect(mem_fun(*this, &MainWindow::on_save_file));
   controller_.save_all    .connect(mem_fun(*this, &MainWindow::on_save_all));
   controller_.undo        .connect(mem_fun(*this, &MainWindow::on_undo));
@@ -401,18 +424,29 @@ void MainWindow::connect_signals()
   filetree_->signal_modified_count_changed.connect(
       mem_fun(*this, &MainWindow::on_filetree_modified_count_changed));
 
-  filetree_->signal_pulse.connect(
-      mem_fun(*this, &MainWindow::on_busy_action_pulse));
-
   filetree_->signal_undo_stack_push.connect(
       mem_fun(*this, &MainWindow::on_undo_stack_push));
+
+  progress_.signal_frame.connect(
+      mem_fun(*this, &MainWindow::on_busy_action_yield));
+
+  const Glib::RefPtr<Gtk::Adjustment> vadjustment = scrollwin_textview_->get_vadjustment();
+
+  vadjustment->signal_value_changed().connect(
+      mem_fun(highlight_range_changed_, &Util::QueuedSignal::queue));
+
+  vadjustment->signal_changed().connect(
+      mem_fun(highlight_range_changed_, &Util::QueuedSignal::queue));
+
+  highlight_range_changed_.connect(
+      mem_fun(*this, &MainWindow::update_highlight_range));
 }
 
 bool MainWindow::autorun_idle()
 {
   controller_.find_files.activate();
 
-  if (!busy_action_cancel_ && entry_regex_->get_text_length() > 0)
+  if (!progress_.is_cancelled() && entry_regex_->get_text_length() > 0)
     controller_.find_matches.activate();
 
   return false;
@@ -604,7 +638,8 @@ void MainWindow::on_find_files()
 
     filetree_->find_files(folder, pattern,
                           button_recursive_->get_active(),
-                          button_hidden_->get_active());
+                          button_hidden_->get_active(),
+                          progress_);
   }
   catch (const Glib::RegexError&)
   {
@@ -623,31 +658,58 @@ void MainWindow::on_find_files()
 }
 
 void MainWindow::on_exec_search()
+{
+  live_search_.cancel();
+  exec_search(true);
+}
+
+/*
+ * Run the search, either on request or while the user is typing.  Only an
+ * interactive search adds the expression to the history, and complains if
+ * it is invalid, which is nothing unusual in the middle of typing it.
+ */
+void MainWindow::exec_search(bool interactive)
 {
   BusyAction busy (*this);
 
   const Glib::ustring regex = entry_regex_->get_text();
   const bool caseless = button_caseless_->get_active();
   const bool multiple = button_multiple_->get_active();
+  const bool multiline = button_multiline_->get_active();
 
-  entry_regex_completion_stack_.push(regex);
+  if (interactive)
+  {
+    entry_regex_completion_stack_.push(regex);
 
-  Settings::instance()->set_string_array(conf_key_regex_patterns, entry_regex_completion_stack_.get_stack());
+    Settings::instance()->set_string_array(conf_key_regex_patterns,
+                                           entry_regex_completion_stack_.get_stack());
+  }
 
   try
   {
-    Glib::RefPtr<Glib::Regex> pattern =
-        Glib::Regex::create(regex, (caseless) ? Glib::REGEX_CASELESS
-                                              : static_cast<Glib::RegexCompileFlags>(0));
+    Glib::RegexCompileFlags flags = get_scan_compile_flags(multiline);
+
+    if (caseless)
+      flags |= Glib::REGEX_CASELESS;
+
+    // With PCRE's JIT compiler available, optimizing makes the matching
+    // several times faster, at the cost of a slower compilation.
+    if (Settings::instance()->get_boolean(conf_key_optimize_regex))
+      flags |= Glib::REGEX_OPTIMIZE;
+
+    const Glib::RefPtr<Glib::Regex> pattern = regex_cache_.get(regex, flags);
 
-    filetree_->find_matches(pattern, multiple);
+    search_running_ = true;
+    filetree_->find_matches(pattern, multiple, progress_);
   }
   catch (const Glib::RegexError& error)
   {
-    Gtk::MessageDialog dialog (*window_, error.what(), false,
-                               Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
-    dialog.run();
-
+    if (interactive)
+    {
+      Gtk::MessageDialog dialog (*window_, error.what(), false,
+                                 Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
+      dialog.run();
+    }
     return;
   }
 
@@ -657,7 +719,9 @@ void MainWindow::on_exec_search()
     statusline_->set_match_index(buffer->get_match_index());
   }
 
-  if (filetree_->get_match_count() > 0)
+  // A search started while typing leaves the selection and the cursor
+  // alone, since the user is still busy with the expression.
+  if (interactive && filetree_->get_match_count() > 0)
   {
     // Scrolling has to be post-poned after the redraw, otherwise we might
     // not end up where we want to.  So do that by installing an idle handler.
@@ -676,6 +740,32 @@ bool MainWindow::after_exec_search()
   return false;
 }
 
+void MainWindow::on_live_search_changed()
+{
+  if (!Settings::instance()->get_boolean(conf_key_search_as_you_type))
+    return;
+
+  // The results for the previous expression aren't of interest anymore.
+  if (search_running_)
+    progress_.cancel();
+
+  live_search_.queue();
+}
+
+void MainWindow::on_live_search()
+{
+  // Wait until the running action is done, which is usually the search
+  // cancelled above, and then try again.
+  if (busy_action_running_)
+  {
+    live_search_.queue();
+    return;
+  }
+
+  if (entry_regex_->get_text_length() > 0 && filetree_->get_file_count() > 0)
+    exec_search(false);
+}
+
 void MainWindow::on_filetree_switch_buffer(FileInfoPtr fileinfo, int file_index)
 {
   const FileBufferPtr old_buffer = FileBufferPtr::cast_static(textview_->get_buffer());
@@ -697,6 +787,8 @@ void MainWindow::on_filetree_switch_buffer(FileInfoPtr fileinfo, int file_index)
     const FileBufferPtr buffer = fileinfo->buffer;
     g_return_if_fail(buffer);
 
+    install_syntax_highlighting(fileinfo);
+
     textview_->set_buffer(buffer);
     textview_->set_editable(!fileinfo->load_failed);
     textview_->set_cursor_visible(!fileinfo->load_failed);
@@ -711,8 +803,14 @@ void MainWindow::on_filetree_switch_buffer(FileInfoPtr fileinfo, int file_index)
 
       buffer_connections_.push_back(buffer->signal_preview_line_changed.
           connect(sigc::mem_fun(*this, &MainWindow::update_preview)));
+
+      // Editing might move matches into the visible area.
+      buffer_connections_.push_back(buffer->signal_changed().
+          connect(sigc::mem_fun(highlight_range_changed_, &Util::QueuedSignal::queue)));
     }
 
+    highlight_range_changed_.queue();
+
     set_title_filename(fileinfo->fullname);
 
     controller_.replace_file.set_enabled(buffer->get_match_count() > 0);
@@ -799,6 +897,31 @@ bool MainWindow::do_scroll(const Glib::RefPtr<Gtk::TextMark> mark)
   return false;
 }
 
+/*
+ * Only the matches in the visible part of the text view are highlighted.
+ * Tagging all of them would take ages with many matches, since every tag
+ * toggle splits the text segments of the buffer.
+ */
+void MainWindow::update_highlight_range()
+{
+  if (const FileBufferPtr buffer = FileBufferPtr::cast_static(textview_->get_buffer()))
+  {
+    Gdk::Rectangle visible;
+    textview_->get_visible_rect(visible);
+
+    FileBuffer::iterator range_begin;
+    FileBuffer::iterator range_end;
+    int line_top = 0;
+
+    textview_->get_line_at_y(range_begin, visible.get_y(), line_top);
+    textview_->get_line_at_y(range_end, visible.get_y() + visible.get_height(), line_top);
+
+    range_end.forward_line();
+
+    buffer->set_highlight_range(range_begin, range_end);
+  }
+}
+
 void MainWindow::on_go_next(bool move_forward)
 {
   if (const FileBufferPtr buffer = FileBufferPtr::cast_static(textview_->get_buffer()))
@@ -849,7 +972,7 @@ void MainWindow::on_replace_all()
   const Glib::ustring substitution = entry_substitution_->get_text();
   entry_substitution_completion_stack_.push(substitution);
   Settings::instance()->set_string_array(conf_key_substitution_patterns, entry_substitution_completion_stack_.get_stack());
-  filetree_->replace_all_matches(substitution);
+  filetree_->replace_all_matches(substitution, progress_);
   statusline_->set_match_index(0);
 }
 
@@ -895,7 +1018,7 @@ void MainWindow::on_undo()
   if (textview_->is_focus())
   {
     BusyAction busy (*this);
-    undo_stack_->undo_step(sigc::mem_fun(*this, &MainWindow::on_busy_action_pulse));
+    undo_stack_->undo_step(sigc::mem_fun(progress_, &ProgressReporter::poll));
     controller_.undo.set_enabled(!undo_stack_->empty());
   }
 }
@@ -970,9 +1093,14 @@ void MainWindow::busy_action_enter()
 
   statusline_->pulse_start();
 
-  busy_action_running_    = true;
-  busy_action_cancel_     = false;
-  busy_action_iteration_  = 0;
+  busy_action_running_ = true;
+  busy_action_stats_   = Stats::get_snapshot();
+  progress_.reset();
+
+  // The display is refreshed at a fixed rate, no matter how often the
+  // action polls the progress reporter.
+  busy_action_frame_ = Glib::signal_timeout().connect(
+      sigc::mem_fun(*this, &MainWindow::on_busy_action_frame), BUSY_FRAME_INTERVAL);
 }
 
 void MainWindow::busy_action_leave()
@@ -980,33 +1108,70 @@ void MainWindow::busy_action_leave()
   g_return_if_fail(busy_action_running_);
 
   busy_action_running_ = false;
+  search_running_      = false;
 
+  busy_action_frame_.disconnect();
   statusline_->pulse_stop();
 
+  // Tell where the time went, for anyone curious why it took so long.
+  const StatsSnapshot stats = Stats::get_snapshot().since(busy_action_stats_);
+  statusline_->set_stats_report(Stats::format_report(stats, progress_.get_counts().elapsed));
+
   controller_.match_actions.set_enabled(true);
 }
 
-bool MainWindow::on_busy_action_pulse()
+/*
+ * Called by the progress reporter once per frame while a busy action runs
+ * on the GUI thread, which is the only chance to handle pending events.
+ */
+void MainWindow::on_busy_action_yield()
+{
+  g_return_if_fail(busy_action_running_);
+
+  const Glib::RefPtr<Glib::MainContext> context = Glib::MainContext::get_default();
+
+  do {}
+  while (context->iteration(false) && !progress_.is_cancelled());
+}
+
+/*
+ * Once the total amount of work is known, show the actual progress,
+ * otherwise just let the progress bar bounce back and forth.  The time
+ * left is extrapolated from the average throughput so far.
+ */
+bool MainWindow::on_busy_action_frame()
 {
-  g_return_val_if_fail(busy_action_running_, true);
+  const ProgressCounts counts = progress_.get_counts();
 
-  if (!busy_action_cancel_ && (++busy_action_iteration_ % BUSY_GUI_UPDATE_INTERVAL) == 0)
+  if (counts.bytes_total == 0)
   {
     statusline_->pulse();
+    return true;
+  }
+
+  const double fraction = std::min(1.0, double(counts.bytes_done) / counts.bytes_total);
+  const double seconds  = counts.elapsed / 1000000.0;
 
-    const Glib::RefPtr<Glib::MainContext> context = Glib::MainContext::get_default();
+  double bytes_per_second = 0.0;
+  double seconds_left     = 0.0;
 
-    do {}
-    while (context->iteration(false) && !busy_action_cancel_);
+  // The first moments aren't representative, mostly due to cold caches.
+  if (seconds >= ESTIMATE_MIN_ELAPSED && counts.bytes_done > 0)
+  {
+    bytes_per_second = counts.bytes_done / seconds;
+    seconds_left     = (counts.bytes_total - std::min(counts.bytes_total, counts.bytes_done))
+                       / bytes_per_second;
   }
 
-  return busy_action_cancel_;
+  statusline_->set_progress(fraction, bytes_per_second, seconds_left);
+
+  return true; // keep the timeout connected
 }
 
 void MainWindow::on_busy_action_cancel()
 {
   if (busy_action_running_)
-    busy_action_cancel_ = true;
+    progress_.cancel();
 }
 
 void MainWindow::on_about()
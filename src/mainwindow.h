@@ -23,8 +23,12 @@
 
 #include "controller.h"
 #include "filebuffer.h"
+#include "progress.h"
 #include "sharedptr.h"
+#include "stats.h"
+#include "signalutils.h"
 #include "completionstack.h"
+#include "regexcache.h"
 
 #include <sigc++/sigc++.h>
 #include <glibmm/refptr.h>
@@ -73,8 +77,12 @@ struct InitState
   bool                      hidden;
   bool                      no_global;
   bool                      ignorecase;
+  bool                      multiline;
   bool                      feedback;
   bool                      no_autorun;
+  bool                      batch;
+  bool                      in_place;
+  bool                      stats;
 
   InitState();
   ~InitState();
@@ -111,6 +119,7 @@ private:
   Gtk::Entry*                 entry_regex_;
   CompletionStack             entry_regex_completion_stack_;
   Glib::RefPtr<Gtk::EntryCompletion> entry_regex_completion_;
+  RegexCache                  regex_cache_;
 
   Gtk::ComboBoxText*          comboboxentry_substitution_;
   Gtk::Entry*                 entry_substitution_;
@@ -119,6 +128,7 @@ private:
 
   Gtk::CheckButton*           button_multiple_;
   Gtk::CheckButton*           button_caseless_;
+  Gtk::CheckButton*           button_multiline_;
 
   FileTree*                   filetree_;
   Gtk::ScrolledWindow*        scrollwin_filetree_;
@@ -129,12 +139,16 @@ private:
   StatusLine*                 statusline_;
 
   bool                        busy_action_running_;
-  bool                        busy_action_cancel_;
-  unsigned int                busy_action_iteration_;
+  ProgressReporter            progress_;
+  sigc::connection            busy_action_frame_;
+  StatsSnapshot               busy_action_stats_;
+  bool                        search_running_;
+  Util::DelayedSignal         live_search_;
 
   UndoStackPtr                undo_stack_;
 
   std::list<sigc::connection> buffer_connections_;
+  Util::QueuedSignal          highlight_range_changed_;
 
   std::auto_ptr<Gtk::Dialog>  about_dialog_;
   std::auto_ptr<PrefDialog>   pref_dialog_;
@@ -158,7 +172,10 @@ private:
 
   void on_find_files();
   void on_exec_search();
+  void exec_search(bool interactive);
   bool after_exec_search();
+  void on_live_search_changed();
+  void on_live_search();
 
   void on_filetree_switch_buffer(Util::SharedPtr<FileInfo> fileinfo, int file_index);
   void on_filetree_file_count_changed();
@@ -169,6 +186,7 @@ private:
   void on_buffer_modified_changed();
 
   bool do_scroll(const Glib::RefPtr<Gtk::TextMark> mark);
+  void update_highlight_range();
 
   void on_go_next_file(bool move_forward);
   void on_go_next(bool move_forward);
@@ -189,7 +207,8 @@ private:
 
   void busy_action_enter();
   void busy_action_leave();
-  bool on_busy_action_pulse();
+  void on_busy_action_yield();
+  bool on_busy_action_frame();
   void on_busy_action_cancel();
 
   void on_about();
@@ -21,6 +21,9 @@
 #ifndef REGEXXER_MISCUTILS_H_INCLUDED
 #define REGEXXER_MISCUTILS_H_INCLUDED
 
+#include <glib.h>
+#include <unistd.h>
+
 namespace Util
 {
 
@@ -49,6 +52,57 @@ inline Iterator next(Iterator pos) { return ++pos; }
 template <class Iterator>
 inline Iterator prior(Iterator pos) { return --pos; }
 
+
+/* A flag to request the cancellation of an operation, which may be
+ * checked from any thread, e.g. by the workers of a thread pool.
+ */
+class CancelToken
+{
+private:
+  volatile gint cancelled_;
+
+  CancelToken(const CancelToken&);
+  CancelToken& operator=(const CancelToken&);
+
+public:
+  CancelToken() : cancelled_ (0) {}
+
+  void cancel() { g_atomic_int_set(&cancelled_, 1); }
+  void reset()  { g_atomic_int_set(&cancelled_, 0); }
+
+  bool is_cancelled() const { return (g_atomic_int_get(&cancelled_) != 0); }
+};
+
+
+/* Atomically add to a pointer-sized counter, which doesn't overflow as
+ * easily as a gint.  There is no atomic addition on pointers in older
+ * GLib versions, but compare-and-exchange does the job just as well.
+ */
+inline void atomic_add_size(volatile gpointer* value, gsize count)
+{
+  gpointer old_value;
+
+  do
+    old_value = g_atomic_pointer_get(value);
+  while (!g_atomic_pointer_compare_and_exchange(value, old_value,
+                                                GSIZE_TO_POINTER(GPOINTER_TO_SIZE(old_value)
+                                                                 + count)));
+}
+
+inline gsize atomic_get_size(volatile gpointer* value)
+{
+  return GPOINTER_TO_SIZE(g_atomic_pointer_get(value));
+}
+
+
+/* The number of processors online, which is used to size thread pools.
+ */
+inline int get_processor_count()
+{
+  const long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0) ? int(count) : 1;
+}
+
 } // namespace Util
 
 #endif /* REGEXXER_MISCUTILS_H_INCLUDED */
@@ -42,6 +42,10 @@ PrefDialog::PrefDialog(Gtk::Window& parent)
   button_match_color_     (0),
   button_current_color_   (0),
   entry_fallback_         (0),
+  button_ignore_files_    (0),
+  button_search_index_    (0),
+  button_optimize_regex_  (0),
+  button_live_search_     (0),
   entry_fallback_changed_ (false)
 {
   load_xml();
@@ -68,6 +72,10 @@ void PrefDialog::load_xml()
   xml->get_widget("button_match_color",   button_match_color_);
   xml->get_widget("button_current_color", button_current_color_);
   xml->get_widget("entry_fallback",       entry_fallback_);
+  xml->get_widget("button_ignore_files",  button_ignore_files_);
+  xml->get_widget("button_search_index",  button_search_index_);
+  xml->get_widget("button_optimize_regex", button_optimize_regex_);
+  xml->get_widget("button_live_search",   button_live_search_);
 
   const Glib::RefPtr<SizeGroup> size_group = SizeGroup::create(SIZE_GROUP_VERTICAL);
 
@@ -144,6 +152,10 @@ void PrefDialog::initialize_configuration()
     on_conf_value_changed(*p);
 
   settings->bind(conf_key_textview_font, button_textview_font_, "font_name");
+  settings->bind(conf_key_use_ignore_files, button_ignore_files_, "active");
+  settings->bind(conf_key_use_search_index, button_search_index_, "active");
+  settings->bind(conf_key_optimize_regex, button_optimize_regex_, "active");
+  settings->bind(conf_key_search_as_you_type, button_live_search_, "active");
 }
 
 void PrefDialog::on_textview_font_set()
@@ -55,6 +55,10 @@ private:
   Gtk::ColorButton*           button_match_color_;
   Gtk::ColorButton*           button_current_color_;
   Gtk::Entry*                 entry_fallback_;
+  Gtk::CheckButton*           button_ignore_files_;
+  Gtk::CheckButton*           button_search_index_;
+  Gtk::CheckButton*           button_optimize_regex_;
+  Gtk::CheckButton*           button_live_search_;
   bool                        entry_fallback_changed_;
 
   void load_xml();
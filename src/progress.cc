@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "progress.h"
+
+namespace Regexxer
+{
+
+/**** Regexxer::ProgressCounts *********************************************/
+
+ProgressCounts::ProgressCounts()
+:
+  files_total (0),
+  files_done  (0),
+  bytes_total (0),
+  bytes_done  (0),
+  matches     (0),
+  elapsed     (0)
+{}
+
+/**** Regexxer::ProgressReporter *******************************************/
+
+/*
+ * The frame interval is given in milliseconds.
+ */
+ProgressReporter::ProgressReporter(unsigned int frame_interval)
+:
+  cancel_token_   (),
+  files_total_    (0),
+  files_done_     (0),
+  bytes_total_    (0),
+  bytes_done_     (0),
+  matches_        (0),
+  start_time_     (0),
+  frame_interval_ (gint64(frame_interval) * 1000),
+  next_frame_     (0)
+{}
+
+ProgressReporter::~ProgressReporter()
+{}
+
+void ProgressReporter::reset()
+{
+  g_atomic_int_set(&files_total_, 0);
+  g_atomic_int_set(&files_done_,  0);
+  g_atomic_pointer_set(&bytes_total_, 0);
+  g_atomic_pointer_set(&bytes_done_,  0);
+  g_atomic_int_set(&matches_,     0);
+
+  cancel_token_.reset();
+
+  start_time_ = g_get_monotonic_time();
+  next_frame_ = start_time_ + frame_interval_;
+}
+
+void ProgressReporter::add_files_total(int count)
+{
+  g_atomic_int_add(&files_total_, count);
+}
+
+void ProgressReporter::add_files_done(int count)
+{
+  g_atomic_int_add(&files_done_, count);
+}
+
+void ProgressReporter::add_bytes_total(gsize count)
+{
+  Util::atomic_add_size(&bytes_total_, count);
+}
+
+void ProgressReporter::add_bytes_done(gsize count)
+{
+  Util::atomic_add_size(&bytes_done_, count);
+}
+
+void ProgressReporter::add_matches(int count)
+{
+  g_atomic_int_add(&matches_, count);
+}
+
+ProgressCounts ProgressReporter::get_counts() const
+{
+  ProgressCounts counts;
+
+  counts.files_total = g_atomic_int_get(&files_total_);
+  counts.files_done  = g_atomic_int_get(&files_done_);
+  counts.bytes_total = GPOINTER_TO_SIZE(g_atomic_pointer_get(&bytes_total_));
+  counts.bytes_done  = GPOINTER_TO_SIZE(g_atomic_pointer_get(&bytes_done_));
+  counts.matches     = g_atomic_int_get(&matches_);
+  counts.elapsed     = g_get_monotonic_time() - start_time_;
+
+  return counts;
+}
+
+bool ProgressReporter::poll()
+{
+  if (!cancel_token_.is_cancelled())
+  {
+    const gint64 now = g_get_monotonic_time();
+
+    if (now >= next_frame_)
+    {
+      signal_frame(); // emit
+
+      // Count from the end of the frame, so that the loop gets to run
+      // for a full interval even if the handler took its time.
+      next_frame_ = g_get_monotonic_time() + frame_interval_;
+    }
+  }
+
+  return cancel_token_.is_cancelled();
+}
+
+} // namespace Regexxer
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef REGEXXER_PROGRESS_H_INCLUDED
+#define REGEXXER_PROGRESS_H_INCLUDED
+
+#include "miscutils.h"
+
+#include <glib.h>
+#include <sigc++/sigc++.h>
+
+namespace Regexxer
+{
+
+/*
+ * A consistent enough picture of the progress made so far.  The counters
+ * are read one after the other, so they may be off by a file in progress.
+ */
+struct ProgressCounts
+{
+  int    files_total;  // 0 if not known in advance
+  int    files_done;
+  gsize  bytes_total;  // likewise
+  gsize  bytes_done;
+  long   matches;
+  gint64 elapsed;      // microseconds since the operation started
+
+  ProgressCounts();
+};
+
+/*
+ * Progress and cancellation of a long operation.  The counters are updated
+ * without any locking, so that the worker threads can account for their
+ * work directly, while the GUI takes a snapshot whenever it redraws.
+ *
+ * Whatever runs on the GUI thread itself has to check in through poll()
+ * from its loops.  This is cheap enough to be done on every iteration:
+ * signal_frame is emitted at most once per frame interval, which gives the
+ * handler the chance to process pending events.  Thus the GUI is updated
+ * at the same pace no matter how fast the loop spins.
+ */
+class ProgressReporter
+{
+public:
+  explicit ProgressReporter(unsigned int frame_interval);
+  ~ProgressReporter();
+
+  // Clear the counters and the cancel request for a new operation.
+  void reset();
+
+  void cancel() { cancel_token_.cancel(); }
+  bool is_cancelled() const { return cancel_token_.is_cancelled(); }
+
+  // These may be called from any thread.
+  void add_files_total(int count);
+  void add_files_done(int count);
+  void add_bytes_total(gsize count);
+  void add_bytes_done(gsize count);
+  void add_matches(int count);
+
+  ProgressCounts get_counts() const;
+
+  // Returns whether the operation has been cancelled.  GUI thread only.
+  bool poll();
+
+  sigc::signal<void> signal_frame;
+
+private:
+  Util::CancelToken cancel_token_;
+  volatile gint     files_total_;
+  volatile gint     files_done_;
+  volatile gpointer bytes_total_; // a gsize, so that it won't overflow
+  volatile gpointer bytes_done_;  // likewise
+  volatile gint     matches_;
+  gint64            start_time_;
+  gint64            frame_interval_;
+  gint64            next_frame_;
+
+  ProgressReporter(const ProgressReporter&);
+  ProgressReporter& operator=(const ProgressReporter&);
+};
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_PROGRESS_H_INCLUDED */
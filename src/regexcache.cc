@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "regexcache.h"
+
+namespace Regexxer
+{
+
+/**** Regexxer::RegexCache *************************************************/
+
+RegexCache::RegexCache(unsigned int capacity)
+:
+  entries_  (),
+  capacity_ (capacity)
+{}
+
+RegexCache::~RegexCache()
+{}
+
+Glib::RefPtr<Glib::Regex> RegexCache::get(const Glib::ustring& pattern,
+                                          Glib::RegexCompileFlags flags)
+{
+  const Key key (pattern, flags);
+
+  // The cache is tiny, so a linear search is just fine.
+  for (EntryList::iterator p = entries_.begin(); p != entries_.end(); ++p)
+  {
+    if (p->first == key)
+    {
+      entries_.splice(entries_.begin(), entries_, p);
+      return p->second;
+    }
+  }
+
+  const Glib::RefPtr<Glib::Regex> regex = Glib::Regex::create(pattern, flags);
+
+  entries_.push_front(Entry(key, regex));
+
+  if (entries_.size() > capacity_)
+    entries_.pop_back();
+
+  return regex;
+}
+
+void RegexCache::clear()
+{
+  entries_.clear();
+}
+
+} // namespace Regexxer
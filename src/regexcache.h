@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef REGEXXER_REGEXCACHE_H_INCLUDED
+#define REGEXXER_REGEXCACHE_H_INCLUDED
+
+#include <glibmm/refptr.h>
+#include <glibmm/regex.h>
+#include <glibmm/ustring.h>
+#include <list>
+#include <utility>
+
+namespace Regexxer
+{
+
+/*
+ * Keep the most recently used compiled patterns, so that searching again
+ * for a pattern from the history doesn't compile it anew.  That matters
+ * mostly for optimized patterns, which take a lot longer to compile.
+ */
+class RegexCache
+{
+public:
+  explicit RegexCache(unsigned int capacity);
+  ~RegexCache();
+
+  // Return the pattern compiled with the given flags, and compile it only
+  // if it isn't in the cache already.  Throws Glib::RegexError.
+  Glib::RefPtr<Glib::Regex> get(const Glib::ustring& pattern, Glib::RegexCompileFlags flags);
+
+  void clear();
+
+private:
+  typedef std::pair<Glib::ustring, Glib::RegexCompileFlags>   Key;
+  typedef std::pair<Key, Glib::RefPtr<Glib::Regex> >          Entry;
+  typedef std::list<Entry>                                    EntryList;
+
+  EntryList     entries_; // most recently used first
+  unsigned int  capacity_;
+
+  RegexCache(const RegexCache&);
+  RegexCache& operator=(const RegexCache&);
+};
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_REGEXCACHE_H_INCLUDED */
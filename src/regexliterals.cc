@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "regexliterals.h"
+
+#include <glib.h>
+#include <glibmm/regex.h>
+#include <cstring>
+
+#include <config.h>
+
+namespace
+{
+
+/*
+ * Skip a character class.  The argument points right behind the opening
+ * bracket; returns the position behind the closing one, or 0 if the class
+ * isn't terminated.
+ */
+static
+const char* skip_class(const char* p)
+{
+  if (*p == '^')
+    ++p;
+  if (*p == ']') // literal bracket at the start
+    ++p;
+
+  while (*p != ']')
+  {
+    if (*p == '\0')
+      return 0;
+
+    if (*p == '\\' && p[1] != '\0')
+    {
+      p += 2;
+    }
+    else if (*p == '[' && p[1] == ':') // POSIX class like [:alpha:]
+    {
+      const char *const end = std::strstr(p + 2, ":]");
+
+      if (!end)
+        return 0;
+
+      p = end + 2;
+    }
+    else
+      ++p;
+  }
+
+  return p + 1;
+}
+
+/*
+ * Skip a parenthesized group including all nested groups.  The argument
+ * points right behind the opening parenthesis; returns the position behind
+ * the closing one, or 0 if the group isn't terminated.
+ */
+static
+const char* skip_group(const char* p)
+{
+  int depth = 1;
+
+  while (*p != '\0')
+  {
+    switch (*p)
+    {
+      case '\\':
+        if (p[1] == '\0' || p[1] == 'Q')
+          return 0; // don't bother with quoting
+        p += 2;
+        continue;
+      case '[':
+        if (!(p = skip_class(p + 1)))
+          return 0;
+        continue;
+      case '(':
+        ++depth;
+        break;
+      case ')':
+        if (--depth == 0)
+          return p + 1;
+        break;
+    }
+
+    ++p;
+  }
+
+  return 0;
+}
+
+/*
+ * Parse a quantifier at position p and advance p past it.  Returns false
+ * if there is none; otherwise optional is set to whether the quantified
+ * atom may be absent.  Note that a brace that doesn't start a valid
+ * quantifier is just a literal character in PCRE.
+ */
+static
+bool parse_quantifier(const char*& p, bool& optional)
+{
+  const char* q = p;
+
+  switch (*q)
+  {
+    case '*': case '?':
+      optional = true;
+      ++q;
+      break;
+
+    case '+':
+      optional = false;
+      ++q;
+      break;
+
+    case '{':
+      if (!g_ascii_isdigit(*++q))
+        return false;
+
+      optional = true;
+
+      for (; g_ascii_isdigit(*q); ++q)
+      {
+        if (*q != '0')
+          optional = false;
+      }
+      if (*q == ',')
+      {
+        for (++q; g_ascii_isdigit(*q); ++q) {}
+      }
+      if (*q++ != '}')
+        return false;
+      break;
+
+    default:
+      return false;
+  }
+
+  if (*q == '?' || *q == '+') // lazy or possessive
+    ++q;
+
+  p = q;
+  return true;
+}
+
+static
+void flush_literal(std::string& current, std::vector<std::string>& literals)
+{
+  if (!current.empty())
+  {
+    literals.push_back(std::string());
+    literals.back().swap(current);
+  }
+}
+
+static
+bool parse_pattern(const char* p, std::vector<std::string>& literals)
+{
+  std::string current;
+
+  while (*p != '\0')
+  {
+    const char* literal_begin = 0;
+
+    switch (*p)
+    {
+      case '\\':
+        if (p[1] == '\0')
+          return false;
+
+        if (g_ascii_isalnum(p[1]))
+        {
+          // Escapes which match a single character or an assertion just
+          // interrupt the literal.  Anything else, like backreferences or
+          // escapes with arguments, is beyond the scope of this analysis.
+          if (!std::strchr("dDwWsSbBAZzGhHvVRntrfae", p[1]))
+            return false;
+
+          flush_literal(current, literals);
+          p += 2;
+        }
+        else
+        {
+          literal_begin = ++p; // escaped literal character
+        }
+        break;
+
+      case '.': case '^': case '$':
+        flush_literal(current, literals);
+        ++p;
+        break;
+
+      case '[':
+        flush_literal(current, literals);
+        if (!(p = skip_class(p + 1)))
+          return false;
+        break;
+
+      case '(':
+        // Inline option settings like (?i) change the meaning of the rest.
+        if (p[1] == '?' && std::strchr("imsxJUX-", p[2]))
+          return false;
+
+        flush_literal(current, literals);
+        if (!(p = skip_group(p + 1)))
+          return false;
+        break;
+
+      case ')': case '|': case '*': case '+': case '?':
+        return false; // alternatives or syntax error
+
+      default:
+        literal_begin = p;
+        break;
+    }
+
+    if (literal_begin)
+    {
+      p = g_utf8_next_char(literal_begin);
+      bool optional = false;
+
+      if (!parse_quantifier(p, optional))
+      {
+        current.append(literal_begin, p);
+      }
+      else
+      {
+        // A repeated character is still required once, but whatever
+        // follows isn't adjacent to it anymore.
+        if (!optional)
+          current.append(literal_begin, g_utf8_next_char(literal_begin));
+
+        flush_literal(current, literals);
+      }
+    }
+    else
+    {
+      // A quantifier applies to the whole atom, which has been skipped.
+      bool optional = false;
+      parse_quantifier(p, optional);
+    }
+  }
+
+  flush_literal(current, literals);
+
+  return true;
+}
+
+/*
+ * Split the literals at non-ASCII characters and convert them to lowercase,
+ * since GRegex folds the case of non-ASCII characters in ways that can't be
+ * reproduced with simple byte comparisons.  The same goes for the letters k
+ * and s, which also match U+212A KELVIN SIGN and U+017F LATIN SMALL LETTER
+ * LONG S respectively.
+ */
+static
+void fold_literals(std::vector<std::string>& literals)
+{
+  std::vector<std::string> folded;
+
+  for (std::vector<std::string>::const_iterator p = literals.begin(); p != literals.end(); ++p)
+  {
+    std::string current;
+
+    for (std::string::const_iterator c = p->begin(); c != p->end(); ++c)
+    {
+      const char lower = g_ascii_tolower(*c);
+
+      if ((*c & 0x80) == 0 && lower != 'k' && lower != 's')
+        current += lower;
+      else
+        flush_literal(current, folded);
+    }
+
+    flush_literal(current, folded);
+  }
+
+  literals.swap(folded);
+}
+
+static
+bool has_line_terminator(const std::string& literal)
+{
+  return (literal.find_first_of("\r\n") != std::string::npos
+          || literal.find("\342\200\251") != std::string::npos);
+}
+
+/*
+ * The portable fallback for memmem().  It is still reasonably fast since
+ * memchr() is highly optimized in any decent C library.
+ */
+static
+const char* find_bytes(const char* data, std::size_t size, const std::string& literal)
+{
+#ifdef HAVE_MEMMEM
+  return static_cast<const char*>(memmem(data, size, literal.data(), literal.size()));
+#else
+  const char *const last = data + size - literal.size();
+  const char* p = data;
+
+  for (; p <= last; ++p)
+  {
+    if (!(p = static_cast<const char*>(std::memchr(p, literal[0], last - p + 1))))
+      break;
+
+    if (std::memcmp(p + 1, literal.data() + 1, literal.size() - 1) == 0)
+      return p;
+  }
+
+  return 0;
+#endif
+}
+
+/*
+ * Search for an ASCII literal that has already been converted to lowercase.
+ */
+static
+const char* find_bytes_caseless(const char* data, std::size_t size, const std::string& literal)
+{
+  const char *const last = data + size - literal.size();
+  const char first = literal[0];
+
+  for (const char* p = data; p <= last; ++p)
+  {
+    if (g_ascii_tolower(*p) != first)
+      continue;
+
+    std::string::size_type i = 1;
+
+    while (i < literal.size() && g_ascii_tolower(p[i]) == literal[i])
+      ++i;
+
+    if (i == literal.size())
+      return p;
+  }
+
+  return 0;
+}
+
+} // anonymous namespace
+
+namespace Regexxer
+{
+
+bool get_required_literals(const Glib::RefPtr<Glib::Regex>& pattern,
+                           std::vector<std::string>& literals, bool& caseless)
+{
+  const GRegexCompileFlags flags = g_regex_get_compile_flags(pattern->gobj());
+
+  if ((flags & G_REGEX_EXTENDED) != 0)
+    return false;
+
+  std::vector<std::string> result;
+
+  if (!parse_pattern(g_regex_get_pattern(pattern->gobj()), result))
+    return false;
+
+  caseless = ((flags & G_REGEX_CASELESS) != 0);
+
+  if (caseless)
+    fold_literals(result);
+
+  literals.swap(result);
+  return true;
+}
+
+/**** Regexxer::LiteralFilter **********************************************/
+
+LiteralFilter::LiteralFilter(const Glib::RefPtr<Glib::Regex>& pattern)
+:
+  literal_  (),
+  caseless_ (false)
+{
+  std::vector<std::string> literals;
+
+  if (!get_required_literals(pattern, literals, caseless_))
+    return;
+
+  for (std::vector<std::string>::const_iterator p = literals.begin(); p != literals.end(); ++p)
+  {
+    if (p->size() > literal_.size() && !has_line_terminator(*p))
+      literal_ = *p;
+  }
+}
+
+LiteralFilter::~LiteralFilter()
+{}
+
+std::size_t LiteralFilter::find(const char* data, std::size_t size, std::size_t pos) const
+{
+  if (literal_.empty())
+    return pos;
+
+  if (pos >= size || size - pos < literal_.size())
+    return size;
+
+  const char *const found = (caseless_)
+      ? find_bytes_caseless(data + pos, size - pos, literal_)
+      : find_bytes(data + pos, size - pos, literal_);
+
+  return (found) ? found - data : size;
+}
+
+} // namespace Regexxer
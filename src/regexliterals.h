@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef REGEXXER_REGEXLITERALS_H_INCLUDED
+#define REGEXXER_REGEXLITERALS_H_INCLUDED
+
+#include <glibmm/refptr.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Glib { class Regex; }
+
+namespace Regexxer
+{
+
+/*
+ * Find literal substrings which occur in every match of pattern.  Returns
+ * false if the pattern is too complex to be analyzed, in which case no
+ * conclusions can be drawn from the literals.  The analysis is deliberately
+ * conservative:  alternatives, backreferences and inline option settings
+ * simply make it give up, and groups are skipped entirely.
+ *
+ * If the pattern is caseless, caseless is set to true and the literals are
+ * reduced to their ASCII parts, converted to lowercase.  The letters k and s
+ * are left out as well, since they match non-ASCII characters too.
+ */
+bool get_required_literals(const Glib::RefPtr<Glib::Regex>& pattern,
+                           std::vector<std::string>& literals, bool& caseless);
+
+/*
+ * Locate the candidates for a match of pattern by searching for the longest
+ * literal it requires, which is way faster than running the regex engine.
+ * If the pattern can't be analyzed, the filter is inactive and everything
+ * is a candidate.  Literals containing line terminators aren't used, so a
+ * line without an occurrence of the literal never matches.
+ */
+class LiteralFilter
+{
+public:
+  explicit LiteralFilter(const Glib::RefPtr<Glib::Regex>& pattern);
+  ~LiteralFilter();
+
+  bool is_active() const { return !literal_.empty(); }
+
+  // Return the position of the next occurrence of the literal at or after
+  // pos, or size if there is none.  If the filter is inactive, return pos.
+  std::size_t find(const char* data, std::size_t size, std::size_t pos) const;
+
+private:
+  std::string literal_;
+  bool        caseless_;
+
+  LiteralFilter(const LiteralFilter&);
+  LiteralFilter& operator=(const LiteralFilter&);
+};
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_REGEXLITERALS_H_INCLUDED */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "savepool.h"
+#include "fileio.h"
+
+#include <glibmm/error.h>
+
+namespace Regexxer
+{
+
+/**** Regexxer::SaveJob ****************************************************/
+
+SaveJob::SaveJob()
+:
+  done (false)
+{}
+
+SaveJob::~SaveJob()
+{}
+
+/**** Regexxer::SavePool ***************************************************/
+
+SavePool::SavePool(int queue_depth)
+:
+  mutex_      (),
+  cond_done_  (),
+  threads_    (queue_depth)
+{}
+
+SavePool::~SavePool()
+{
+  threads_.shutdown();
+}
+
+void SavePool::push(SaveJob& job)
+{
+  threads_.push(sigc::bind(sigc::mem_fun(*this, &SavePool::execute), &job));
+}
+
+void SavePool::wait(SaveJob& job)
+{
+  Glib::Mutex::Lock lock (mutex_);
+
+  while (!job.done)
+    cond_done_.wait(mutex_);
+}
+
+/**** Regexxer::SavePool -- private ****************************************/
+
+/*
+ * Executed on a worker thread.  Nothing but thread-safe GLib functionality
+ * must be used here.
+ */
+void SavePool::execute(SaveJob* job)
+{
+  try
+  {
+    save_text(job->fullname, job->encoding, job->text);
+  }
+  catch (const Glib::Error& error)
+  {
+    job->error = error.what();
+  }
+
+  std::string().swap(job->text); // not needed anymore
+
+  Glib::Mutex::Lock lock (mutex_);
+
+  job->done = true;
+  cond_done_.broadcast();
+}
+
+} // namespace Regexxer
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef REGEXXER_SAVEPOOL_H_INCLUDED
+#define REGEXXER_SAVEPOOL_H_INCLUDED
+
+#include <glibmm/thread.h>
+#include <glibmm/threadpool.h>
+#include <glibmm/ustring.h>
+#include <string>
+
+namespace Regexxer
+{
+
+/*
+ * A single file to be written by SavePool.  The text has to be captured
+ * from the buffer on the GUI thread beforehand, since a worker thread must
+ * not touch any GTK+ object.  Like SearchJob, it carries nothing but plain
+ * data, and the result members must not be accessed before SavePool::wait()
+ * returned for the job.
+ */
+struct SaveJob
+{
+  std::string   fullname;
+  std::string   encoding;
+  std::string   text;       // always UTF-8, converted back to encoding
+  Glib::ustring error;      // message of the Glib::Error caught while saving
+  bool          done;       // protected by the mutex of SavePool
+
+  SaveJob();
+  ~SaveJob();
+};
+
+/*
+ * Write files on a number of worker threads, so that slow storage such as
+ * a network file system is kept busy with several files at once.  The
+ * number of threads is the queue depth, that is how many writes may be
+ * in flight at the same time.  Destroying the pool blocks until all jobs
+ * pushed have been completed.
+ */
+class SavePool
+{
+public:
+  explicit SavePool(int queue_depth);
+  ~SavePool();
+
+  void push(SaveJob& job);
+
+  // Block until the job has been processed.
+  void wait(SaveJob& job);
+
+private:
+  Glib::Mutex       mutex_;
+  Glib::Cond        cond_done_;
+  Glib::ThreadPool  threads_;
+
+  SavePool(const SavePool&);
+  SavePool& operator=(const SavePool&);
+
+  void execute(SaveJob* job);
+};
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_SAVEPOOL_H_INCLUDED */
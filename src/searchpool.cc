@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "searchpool.h"
+#include "fileio.h"
+#include "miscutils.h"
+#include "stats.h"
+
+#include <glibmm/fileutils.h>
+#include <glibmm/regex.h>
+#include <glibmm/timeval.h>
+
+namespace Regexxer
+{
+
+/**** Regexxer::SearchJob **************************************************/
+
+SearchJob::SearchJob()
+:
+  load   (false),
+  index  (false),
+  size   (0),
+  binary (false),
+  done   (false)
+{}
+
+SearchJob::~SearchJob()
+{}
+
+void SearchJob::check_loaded() const
+{
+  if (binary)
+    throw ErrorBinaryFile();
+
+  if (!error.empty())
+    throw Glib::FileError(Glib::FileError::FAILED, error);
+}
+
+/**** Regexxer::SearchPool *************************************************/
+
+SearchPool::SearchPool(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                       const std::string& fallback_encoding,
+                       ProgressReporter& progress)
+:
+  pattern_            (pattern),
+  multiple_           (multiple),
+  fallback_encoding_  (fallback_encoding),
+  progress_           (progress),
+  mutex_              (),
+  cond_done_          (),
+  cancelled_          (0),
+  threads_            (Util::get_processor_count())
+{}
+
+SearchPool::~SearchPool()
+{
+  cancel();
+  threads_.shutdown();
+}
+
+void SearchPool::push(SearchJob& job)
+{
+  threads_.push(sigc::bind(sigc::mem_fun(*this, &SearchPool::execute), &job));
+}
+
+bool SearchPool::wait(SearchJob& job, unsigned int timeout_ms)
+{
+  Glib::TimeVal abs_time;
+  abs_time.assign_current_time();
+  abs_time.add_milliseconds(timeout_ms);
+
+  Glib::Mutex::Lock lock (mutex_);
+
+  while (!job.done)
+  {
+    if (!cond_done_.timed_wait(mutex_, abs_time))
+      break;
+  }
+
+  return job.done;
+}
+
+void SearchPool::cancel()
+{
+  g_atomic_int_set(&cancelled_, 1);
+}
+
+/**** Regexxer::SearchPool -- private **************************************/
+
+bool SearchPool::is_cancelled() const
+{
+  return (g_atomic_int_get(&cancelled_) || progress_.is_cancelled());
+}
+
+/*
+ * Executed on a worker thread.  Nothing but thread-safe GLib functionality
+ * must be used here.
+ */
+void SearchPool::execute(SearchJob* job)
+{
+  if (!is_cancelled())
+  {
+    try
+    {
+      if (job->load)
+      {
+        load_text(job->fullname, fallback_encoding_, job->text, job->encoding);
+
+        if (job->index)
+        {
+          ScopedTimer timer (STATS_INDEX);
+          TrigramIndex::get_text_trigrams(job->text, job->trigrams);
+        }
+      }
+
+      ScopedTimer timer (STATS_MATCH);
+
+      const int match_count = scan_text(pattern_, multiple_, job->text, job->matches,
+                                        sigc::mem_fun(*this, &SearchPool::is_cancelled));
+
+      Stats::add_bytes(STATS_MATCH, job->text.size());
+      Stats::add_matches(match_count);
+      progress_.add_matches(match_count);
+
+      if (match_count == 0)
+        std::string().swap(job->text); // not needed anymore
+    }
+    catch (const Glib::Error& error)
+    {
+      job->error = error.what();
+    }
+    catch (const ErrorBinaryFile&)
+    {
+      job->binary = true;
+    }
+
+    progress_.add_files_done(1);
+    progress_.add_bytes_done(job->size);
+  }
+
+  Glib::Mutex::Lock lock (mutex_);
+
+  job->done = true;
+  cond_done_.broadcast();
+}
+
+} // namespace Regexxer
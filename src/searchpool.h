@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef REGEXXER_SEARCHPOOL_H_INCLUDED
+#define REGEXXER_SEARCHPOOL_H_INCLUDED
+
+#include "progress.h"
+#include "textscan.h"
+#include "trigramindex.h"
+
+#include <glib.h>
+#include <glibmm/refptr.h>
+#include <glibmm/thread.h>
+#include <glibmm/threadpool.h>
+#include <glibmm/ustring.h>
+#include <string>
+
+namespace Glib { class Regex; }
+
+namespace Regexxer
+{
+
+/*
+ * A single file to be searched by SearchPool.  The job is processed on a
+ * worker thread, therefore it carries nothing but plain data -- and in
+ * particular no Util::SharedPtr<>, because its reference count isn't
+ * thread-safe.  The result members must not be accessed before
+ * SearchPool::wait() returned true for the job.
+ */
+struct SearchJob
+{
+  std::string   fullname;
+  bool          load;       // read the file, otherwise scan text as it is
+  bool          index;      // collect the trigrams of the loaded text
+  gsize         size;       // bytes of progress the job accounts for
+
+  std::string   text;       // the text of the file, always UTF-8
+  std::string   encoding;   // set by load_text() if load is true
+  ScanMatchList matches;
+  Glib::ustring error;      // message of the Glib::Error caught while loading
+  bool          binary;     // load_text() threw ErrorBinaryFile
+  TrigramSet    trigrams;   // set if index is true
+  bool          done;       // protected by the mutex of SearchPool
+
+  SearchJob();
+  ~SearchJob();
+
+  // Throw the exception load_text() raised on the worker thread, if any.
+  void check_loaded() const;
+};
+
+/*
+ * Scan files for matches on as many threads as there are processors.
+ * Jobs may be completed in any order; the caller is expected to wait()
+ * for each of them in turn, so that the results can be merged back in a
+ * deterministic order.  Destroying the pool cancels the pending jobs and
+ * blocks until the worker threads are done with the running ones.  Pending
+ * jobs are also skipped as soon as the progress reporter is cancelled, so
+ * that the workers don't have to wait for the GUI to notice.  The workers
+ * account for the files, bytes and matches they processed right away.
+ */
+class SearchPool
+{
+public:
+  SearchPool(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+             const std::string& fallback_encoding, ProgressReporter& progress);
+  ~SearchPool();
+
+  void push(SearchJob& job);
+
+  // Block until the job has been processed, or until the timeout expires.
+  // Returns whether the job is done.
+  bool wait(SearchJob& job, unsigned int timeout_ms);
+
+  // Skip all jobs which haven't been started yet, and stop the scans of
+  // the running ones early.
+  void cancel();
+
+private:
+  Glib::RefPtr<Glib::Regex> pattern_;
+  bool                      multiple_;
+  std::string               fallback_encoding_;
+  ProgressReporter&         progress_;
+  Glib::Mutex               mutex_;
+  Glib::Cond                cond_done_;
+  volatile gint             cancelled_;
+  Glib::ThreadPool          threads_;
+
+  SearchPool(const SearchPool&);
+  SearchPool& operator=(const SearchPool&);
+
+  bool is_cancelled() const;
+  void execute(SearchJob* job);
+};
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_SEARCHPOOL_H_INCLUDED */
@@ -58,6 +58,46 @@ bool QueuedSignal::idle_handler()
   return false; // disconnect idle handler
 }
 
+/**** Util::DelayedSignal **************************************************/
+
+DelayedSignal::DelayedSignal(unsigned int interval)
+:
+  signal_   (),
+  interval_ (interval),
+  timeout_  ()
+{}
+
+DelayedSignal::~DelayedSignal()
+{
+  timeout_.disconnect();
+}
+
+sigc::connection DelayedSignal::connect(const sigc::slot<void>& slot)
+{
+  return signal_.connect(slot);
+}
+
+void DelayedSignal::queue()
+{
+  // Start over, so that the interval is counted from the last call.
+  timeout_.disconnect();
+  timeout_ = Glib::signal_timeout().connect(sigc::mem_fun(*this, &DelayedSignal::timeout_handler),
+                                            interval_);
+}
+
+void DelayedSignal::cancel()
+{
+  timeout_.disconnect();
+}
+
+bool DelayedSignal::timeout_handler()
+{
+  timeout_.disconnect();
+  signal_(); // emit
+
+  return false; // disconnect timeout handler
+}
+
 /**** Util::AutoConnection *************************************************/
 
 AutoConnection::AutoConnection()
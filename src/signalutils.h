@@ -48,6 +48,33 @@ private:
   bool idle_handler();
 };
 
+/*
+ * Like QueuedSignal, but emitted only once the given interval has passed
+ * without another call to queue().  Thus a burst of changes, such as the
+ * keystrokes of someone typing, results in a single emission at the end.
+ */
+class DelayedSignal : public sigc::trackable
+{
+public:
+  explicit DelayedSignal(unsigned int interval);
+  virtual ~DelayedSignal();
+
+  sigc::connection connect(const sigc::slot<void>& slot);
+  void queue();
+  void cancel();
+  bool queued() const { return timeout_.connected(); }
+
+private:
+  sigc::signal<void>  signal_;
+  unsigned int        interval_;
+  sigc::connection    timeout_;
+
+  DelayedSignal(const DelayedSignal&);
+  DelayedSignal& operator=(const DelayedSignal&);
+
+  bool timeout_handler();
+};
+
 class AutoConnection
 {
 private:
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "stats.h"
+#include "miscutils.h"
+#include "translation.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace
+{
+
+using namespace Regexxer;
+
+// Zero-initialized, since they have static storage duration.
+volatile gpointer phase_time [STATS_PHASE_COUNT];
+volatile gpointer phase_calls[STATS_PHASE_COUNT];
+volatile gpointer phase_bytes[STATS_PHASE_COUNT];
+volatile gpointer matches_found;
+
+static const char *const phase_names[STATS_PHASE_COUNT] =
+{
+  N_("Finding files"),
+  N_("Reading"),
+  N_("Decoding"),
+  N_("Matching"),
+  N_("Indexing"),
+  N_("Filling buffers"),
+  N_("Guessing languages"),
+  N_("Updating the tree"),
+  N_("Replacing"),
+  N_("Saving")
+};
+
+static
+bool is_io_phase(int phase)
+{
+  return (phase == STATS_WALK || phase == STATS_READ || phase == STATS_SAVE);
+}
+
+static
+Glib::ustring format_seconds(gsize microseconds)
+{
+  return Glib::ustring::format(std::fixed, std::setprecision(3), microseconds / 1000000.0);
+}
+
+static
+Glib::ustring format_mebibytes(gsize bytes)
+{
+  return Glib::ustring::format(std::fixed, std::setprecision(1), bytes / (1024.0 * 1024.0));
+}
+
+} // anonymous namespace
+
+namespace Regexxer
+{
+
+/**** Regexxer::StatsSnapshot **********************************************/
+
+StatsSnapshot StatsSnapshot::since(const StatsSnapshot& earlier) const
+{
+  StatsSnapshot result;
+
+  for (int i = 0; i < STATS_PHASE_COUNT; ++i)
+  {
+    result.phases[i].time  = phases[i].time  - earlier.phases[i].time;
+    result.phases[i].calls = phases[i].calls - earlier.phases[i].calls;
+    result.phases[i].bytes = phases[i].bytes - earlier.phases[i].bytes;
+  }
+
+  result.matches = matches - earlier.matches;
+
+  return result;
+}
+
+/**** Regexxer::Stats ******************************************************/
+
+void Stats::add_time(StatsPhase phase, gint64 time)
+{
+  g_return_if_fail(phase >= 0 && phase < STATS_PHASE_COUNT);
+
+  Util::atomic_add_size(&phase_time[phase], std::max<gint64>(0, time));
+  Util::atomic_add_size(&phase_calls[phase], 1);
+}
+
+void Stats::add_bytes(StatsPhase phase, gsize bytes)
+{
+  g_return_if_fail(phase >= 0 && phase < STATS_PHASE_COUNT);
+
+  Util::atomic_add_size(&phase_bytes[phase], bytes);
+}
+
+void Stats::add_matches(gsize count)
+{
+  Util::atomic_add_size(&matches_found, count);
+}
+
+StatsSnapshot Stats::get_snapshot()
+{
+  StatsSnapshot snapshot;
+
+  for (int i = 0; i < STATS_PHASE_COUNT; ++i)
+  {
+    snapshot.phases[i].time  = Util::atomic_get_size(&phase_time[i]);
+    snapshot.phases[i].calls = Util::atomic_get_size(&phase_calls[i]);
+    snapshot.phases[i].bytes = Util::atomic_get_size(&phase_bytes[i]);
+  }
+
+  snapshot.matches = Util::atomic_get_size(&matches_found);
+
+  return snapshot;
+}
+
+Glib::ustring Stats::format_report(const StatsSnapshot& snapshot, gint64 wall_time)
+{
+  Glib::ustring report = Util::compose(_("Total: %1 s"), format_seconds(std::max<gint64>(0, wall_time)));
+
+  gsize io_time  = 0;
+  gsize cpu_time = 0;
+
+  for (int i = 0; i < STATS_PHASE_COUNT; ++i)
+  {
+    const StatsPhaseCounts& phase = snapshot.phases[i];
+
+    if (phase.calls == 0)
+      continue;
+
+    const Glib::ustring name    = _(phase_names[i]);
+    const Glib::ustring seconds = format_seconds(phase.time);
+    const Glib::ustring calls   = Glib::ustring::format(phase.calls);
+
+    report += '\n';
+
+    if (phase.bytes > 0)
+    {
+      const Glib::ustring mebibytes = format_mebibytes(phase.bytes);
+      const Glib::ustring *const argv[] = { &name, &seconds, &calls, &mebibytes };
+
+      report += Util::compose_argv(_("%1: %2 s, %3 calls, %4 MiB"), G_N_ELEMENTS(argv), argv);
+    }
+    else
+    {
+      const Glib::ustring *const argv[] = { &name, &seconds, &calls };
+
+      report += Util::compose_argv(_("%1: %2 s, %3 calls"), G_N_ELEMENTS(argv), argv);
+    }
+
+    if (is_io_phase(i))
+      io_time += phase.time;
+    else
+      cpu_time += phase.time;
+  }
+
+  report += '\n';
+  report += Util::compose(_("Waiting for I/O: %1 s, computing: %2 s"),
+                          format_seconds(io_time), format_seconds(cpu_time));
+  report += '\n';
+  report += Util::compose(_("Matches found: %1"), Glib::ustring::format(snapshot.matches));
+
+  return report;
+}
+
+} // namespace Regexxer
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef REGEXXER_STATS_H_INCLUDED
+#define REGEXXER_STATS_H_INCLUDED
+
+#include <glib.h>
+#include <glibmm/ustring.h>
+
+namespace Regexxer
+{
+
+/*
+ * The phases the time of a search or replace is broken down into.  The
+ * phases run on the worker threads are marked; their times are summed up
+ * over all threads, and may thus add up to more than the time that passed.
+ */
+enum StatsPhase
+{
+  STATS_WALK,       // finding the files
+  STATS_READ,       // reading the files (worker threads)
+  STATS_DECODE,     // validating and converting the encoding (worker threads)
+  STATS_MATCH,      // running the regular expression (partly worker threads)
+  STATS_INDEX,      // maintaining the search index (partly worker threads)
+  STATS_BUFFER,     // loading text and matches into the buffers
+  STATS_LANGUAGE,   // guessing the language for syntax highlighting
+  STATS_TREE,       // updating the file tree
+  STATS_REPLACE,    // substituting the matches
+  STATS_SAVE,       // writing the files (worker threads)
+  STATS_PHASE_COUNT
+};
+
+struct StatsPhaseCounts
+{
+  gsize time;   // microseconds
+  gsize calls;
+  gsize bytes;
+
+  StatsPhaseCounts() : time (0), calls (0), bytes (0) {}
+};
+
+struct StatsSnapshot
+{
+  StatsPhaseCounts  phases[STATS_PHASE_COUNT];
+  gsize             matches;
+
+  StatsSnapshot() : matches (0) {}
+
+  // The difference to an earlier snapshot.
+  StatsSnapshot since(const StatsSnapshot& earlier) const;
+};
+
+/*
+ * Process-wide counters of where the time goes.  They are always collected,
+ * since the cost is a few atomic operations per file.  The counters are
+ * never reset; the statistics of a single operation are obtained from the
+ * snapshots taken before and after.
+ */
+namespace Stats
+{
+
+void add_time(StatsPhase phase, gint64 time);
+void add_bytes(StatsPhase phase, gsize bytes);
+void add_matches(gsize count);
+
+StatsSnapshot get_snapshot();
+
+// A human-readable breakdown of the snapshot, one line per phase, which
+// sums up the time spent waiting for input and output versus computing.
+// The wall time is in microseconds.
+Glib::ustring format_report(const StatsSnapshot& snapshot, gint64 wall_time);
+
+} // namespace Stats
+
+/*
+ * Account the time until the end of the scope to a phase.
+ */
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer(StatsPhase phase)
+    : phase_ (phase), start_ (g_get_monotonic_time()) {}
+
+  ~ScopedTimer() { Stats::add_time(phase_, g_get_monotonic_time() - start_); }
+
+private:
+  StatsPhase  phase_;
+  gint64      start_;
+
+  ScopedTimer(const ScopedTimer&);
+  ScopedTimer& operator=(const ScopedTimer&);
+};
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_STATS_H_INCLUDED */
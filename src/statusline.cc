@@ -24,10 +24,33 @@
 
 #include <gdk/gdkkeysyms.h>
 #include <gtkmm.h>
+#include <iomanip>
 #include <locale>
 #include <sstream>
 #include <stdexcept>
 
+namespace
+{
+
+/*
+ * Format a duration like a clock, as in "4:05" or "1:04:05".
+ */
+static
+Glib::ustring format_duration(double seconds)
+{
+  const long total = long(seconds + 0.5);
+  char buffer[32];
+
+  if (total >= 3600)
+    g_snprintf(buffer, sizeof(buffer), "%ld:%02ld:%02ld", total / 3600, total / 60 % 60, total % 60);
+  else
+    g_snprintf(buffer, sizeof(buffer), "%ld:%02ld", total / 60, total % 60);
+
+  return buffer;
+}
+
+} // anonymous namespace
+
 namespace Regexxer
 {
 
@@ -317,12 +340,43 @@ void StatusLine::pulse()
   progressbar_->pulse();
 }
 
+/*
+ * Show the fraction of the work done, together with the throughput and
+ * the estimated time left.  Either of the latter is omitted if it isn't
+ * positive, which means it is not known yet.
+ */
+void StatusLine::set_progress(double fraction, double bytes_per_second, double seconds_left)
+{
+  progressbar_->set_fraction(fraction);
+
+  Glib::ustring text;
+
+  if (bytes_per_second > 0.0)
+  {
+    const Glib::ustring rate = Glib::ustring::format(std::fixed, std::setprecision(1),
+                                                     bytes_per_second / (1024.0 * 1024.0));
+
+    text = (seconds_left > 0.0)
+        ? Util::compose(_("%1 MiB/s, %2 left"), rate, format_duration(seconds_left))
+        : Util::compose(_("%1 MiB/s"), rate);
+  }
+
+  progressbar_->set_text(text);
+  progressbar_->set_show_text(!text.empty());
+}
+
 void StatusLine::pulse_stop()
 {
   progressbar_->set_fraction(0.0);
+  progressbar_->set_show_text(false);
   stop_button_->set_sensitive(false);
 }
 
+void StatusLine::set_stats_report(const Glib::ustring& report)
+{
+  progressbar_->set_tooltip_text(report);
+}
+
 void StatusLine::on_hierarchy_changed(Gtk::Widget* previous_toplevel)
 {
   if (Gtk::Window *const window = dynamic_cast<Gtk::Window*>(previous_toplevel))
@@ -53,8 +53,12 @@ public:
 
   void pulse_start();
   void pulse();
+  void set_progress(double fraction, double bytes_per_second, double seconds_left);
   void pulse_stop();
 
+  // Shown as tooltip of the progress bar.
+  void set_stats_report(const Glib::ustring& report);
+
   sigc::signal<void> signal_cancel_clicked;
 
 protected:
@@ -526,6 +526,27 @@ Glib::ustring Util::shell_pattern_to_regex(const Glib::ustring& pattern)
   return result;
 }
 
+/*
+ * Combine several shell patterns into a single regular expression, which
+ * matches if any of the patterns does.
+ */
+Glib::ustring Util::shell_patterns_to_regex(const std::vector<Glib::ustring>& patterns)
+{
+  Glib::ustring result;
+
+  for (std::vector<Glib::ustring>::const_iterator p = patterns.begin(); p != patterns.end(); ++p)
+  {
+    if (p != patterns.begin())
+      result += '|';
+
+    result += "(?:";
+    result += Util::shell_pattern_to_regex(*p);
+    result += ')';
+  }
+
+  return result;
+}
+
 Glib::ustring Util::substitute_references(const Glib::ustring& substitution,
                                           const Glib::ustring& subject,
                                           const CaptureVector& captures)
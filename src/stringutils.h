@@ -39,6 +39,7 @@ Glib::ustring wstring_to_utf8(const std::wstring& str);
 bool validate_encoding(const std::string& encoding);
 bool encodings_equal(const std::string& lhs, const std::string& rhs);
 Glib::ustring shell_pattern_to_regex(const Glib::ustring& pattern);
+Glib::ustring shell_patterns_to_regex(const std::vector<Glib::ustring>& patterns);
 
 Glib::ustring substitute_references(const Glib::ustring& substitution,
                                     const Glib::ustring& subject,
@@ -0,0 +1,611 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "textscan.h"
+#include "regexliterals.h"
+
+#include <glib.h>
+#include <glibmm/regex.h>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+using Regexxer::ScanMatch;
+
+typedef std::string::size_type size_type;
+
+// Number of regex runs between two calls of the pulse slot.
+enum { PULSE_INTERVAL = 256 };
+
+/*
+ * Return the position of the terminator of the line starting at pos, and
+ * store the start of the next line in next_line.  The line terminators
+ * recognized are the same as Gtk::TextBuffer's: "\n", "\r", "\r\n" and
+ * U+2029 PARAGRAPH SEPARATOR.
+ */
+static
+size_type find_line_end(const char* text, size_type size, size_type pos, size_type& next_line)
+{
+  for (; pos < size; ++pos)
+  {
+    switch (text[pos])
+    {
+      case '\n':
+        next_line = pos + 1;
+        return pos;
+
+      case '\r':
+        next_line = (pos + 1 < size && text[pos + 1] == '\n') ? pos + 2 : pos + 1;
+        return pos;
+
+      case '\342':
+        if (size - pos >= 3 && std::memcmp(text + pos, "\342\200\251", 3) == 0)
+        {
+          next_line = pos + 3;
+          return pos;
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  next_line = size;
+  return size;
+}
+
+/*
+ * Return whether pos is the start of an empty last line, or of an empty
+ * text.  FileBuffer never searched that line, so matches found there are
+ * ignored for consistency.
+ */
+static
+bool is_at_empty_last_line(const char* text, size_type size, size_type pos)
+{
+  if (pos < size)
+    return false;
+
+  if (size == 0)
+    return true;
+
+  const char last = text[size - 1];
+
+  return (last == '\n' || last == '\r'
+          || (size >= 3 && std::memcmp(text + size - 3, "\342\200\251", 3) == 0));
+}
+
+/*
+ * Advance by one character, where CR LF counts as a single character
+ * since the regex engine never matches in between.
+ */
+static
+size_type next_char(const char* text, size_type size, size_type pos)
+{
+  if (text[pos] == '\r' && pos + 1 < size && text[pos + 1] == '\n')
+    return pos + 2;
+
+  return g_utf8_next_char(text + pos) - text;
+}
+
+/*
+ * Run a regular expression over a text and hand out the matches one after
+ * the other.  The lines are counted on the fly as the scan moves forward,
+ * so that no table of line starts has to be kept in memory.
+ *
+ * If the pattern is multiline, it is run over the text as a whole, so that
+ * a match may span several lines.  Otherwise every line is matched on its
+ * own as if it were the whole subject, and lines that lack the literal
+ * every match requires are skipped without running the regex at all.
+ */
+class TextScanner
+{
+public:
+  TextScanner(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+              const char* text, size_type size,
+              size_type begin, int first_line, size_type end,
+              const sigc::slot<bool>& pulse);
+
+  bool next_match(ScanMatch& match);
+
+private:
+  GRegex*                 regex_;
+  Regexxer::LiteralFilter filter_;
+  sigc::slot<bool>        pulse_;
+  unsigned int            pulse_count_;
+  bool                    multiple_;
+  bool                    multiline_;
+  const char*             text_;
+  size_type               size_;
+  size_type               end_;
+  size_type               offset_;
+  bool                    last_was_empty_;
+  bool                    done_;
+  int                     line_;
+  size_type               line_begin_;
+  size_type               line_end_;
+  size_type               next_line_;
+
+  TextScanner(const TextScanner&);
+  TextScanner& operator=(const TextScanner&);
+
+  void advance_to_line(size_type pos);
+  bool seek_line();
+  bool next_line();
+  bool is_cancelled();
+  bool next_match_multiline(ScanMatch& match);
+  bool next_match_in_line(ScanMatch& match);
+
+  static void fetch_captures(GMatchInfo* match_info, Util::CaptureVector& captures);
+};
+
+/*
+ * The scan starts at begin, which has to be the start of the line with the
+ * number first_line, and looks for matches that start in the lines before
+ * end.  If pulse is not empty, it is called every now and then, and the
+ * scan stops as soon as it returns true.
+ */
+TextScanner::TextScanner(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                         const char* text, size_type size,
+                         size_type begin, int first_line, size_type end,
+                         const sigc::slot<bool>& pulse)
+:
+  regex_          (pattern->gobj()),
+  filter_         (pattern),
+  pulse_          (pulse),
+  pulse_count_    (0),
+  multiple_       (multiple),
+  multiline_      (Regexxer::is_multiline_pattern(pattern)),
+  text_           (text),
+  size_           (size),
+  end_            (end),
+  offset_         (begin),
+  last_was_empty_ (false),
+  done_           (false),
+  line_           (first_line),
+  line_begin_     (begin),
+  line_end_       (0),
+  next_line_      (0)
+{
+  line_end_ = find_line_end(text_, size_, line_begin_, next_line_);
+
+  // Every match contains the literal, so without it there is none at all.
+  if (multiline_)
+    done_ = (filter_.find(text_, size_, line_begin_) >= size_);
+  else
+    done_ = !seek_line();
+}
+
+/*
+ * Move forward to the line that contains pos.  Just like in Gtk::TextBuffer,
+ * a text that ends with a line terminator has an empty last line.
+ */
+void TextScanner::advance_to_line(size_type pos)
+{
+  while (line_end_ < size_ && next_line_ <= pos)
+  {
+    line_begin_ = next_line_;
+    line_end_   = find_line_end(text_, size_, line_begin_, next_line_);
+    ++line_;
+  }
+}
+
+/*
+ * Move on from the current line to the next one that contains the literal,
+ * unless the current one does already.  The empty last line is never
+ * searched, just like FileBuffer never did.  Returns false if there is no
+ * line left to search.
+ */
+bool TextScanner::seek_line()
+{
+  const size_type candidate = filter_.find(text_, size_, line_begin_);
+
+  if (candidate >= size_)
+    return false;
+
+  advance_to_line(candidate);
+
+  if (line_begin_ >= end_)
+    return false;
+
+  offset_ = line_begin_;
+  last_was_empty_ = false;
+
+  return true;
+}
+
+bool TextScanner::next_line()
+{
+  if (line_end_ >= size_)
+    return false;
+
+  line_begin_ = next_line_;
+  line_end_   = find_line_end(text_, size_, line_begin_, next_line_);
+  ++line_;
+
+  return seek_line();
+}
+
+bool TextScanner::is_cancelled()
+{
+  if (pulse_ && ++pulse_count_ >= PULSE_INTERVAL)
+  {
+    pulse_count_ = 0;
+    return pulse_();
+  }
+
+  return false;
+}
+
+// static
+void TextScanner::fetch_captures(GMatchInfo* match_info, Util::CaptureVector& captures)
+{
+  const int capture_count = g_match_info_get_match_count(match_info);
+
+  captures.reserve(capture_count);
+
+  for (int i = 0; i < capture_count; ++i)
+  {
+    std::pair<int, int> bounds;
+    g_match_info_fetch_pos(match_info, i, &bounds.first, &bounds.second);
+    captures.push_back(bounds);
+  }
+}
+
+bool TextScanner::next_match(ScanMatch& match)
+{
+  if (!done_ && ((multiline_) ? next_match_multiline(match) : next_match_in_line(match)))
+    return true;
+
+  done_ = true;
+  return false;
+}
+
+bool TextScanner::next_match_multiline(ScanMatch& match)
+{
+  while (!done_ && offset_ <= size_ && !is_cancelled())
+  {
+    GMatchInfo* match_info = 0;
+
+    const bool is_matched =
+      g_regex_match_full(regex_, text_, size_, offset_,
+                         (last_was_empty_) ? GRegexMatchFlags(G_REGEX_MATCH_ANCHORED
+                                                              | G_REGEX_MATCH_NOTEMPTY)
+                                           : GRegexMatchFlags(0),
+                         &match_info, 0);
+    if (!is_matched)
+    {
+      g_match_info_free(match_info);
+
+      if (last_was_empty_ && offset_ < size_)
+      {
+        offset_ = next_char(text_, size_, offset_);
+        last_was_empty_ = false;
+        continue;
+      }
+      break;
+    }
+
+    Util::CaptureVector captures;
+    fetch_captures(match_info, captures);
+    g_match_info_free(match_info);
+
+    const size_type start = captures.front().first;
+    const size_type stop  = captures.front().second;
+
+    if (is_at_empty_last_line(text_, size_, start))
+      break;
+
+    advance_to_line(start);
+
+    if (line_begin_ >= end_)
+      break;
+
+    // The match is described relative to the line it starts in, but its
+    // subject extends to the end of the line it ends in.
+    size_type subject_end = line_end_;
+
+    if (line_end_ < size_ && stop > next_line_)
+    {
+      const size_type last_char = g_utf8_prev_char(text_ + stop) - text_;
+      size_type next_line = 0;
+
+      subject_end = find_line_end(text_, size_, last_char, next_line);
+    }
+
+    match.line       = line_;
+    match.line_begin = line_begin_;
+    match.line_end   = std::max(subject_end, stop);
+
+    for (Util::CaptureVector::iterator p = captures.begin(); p != captures.end(); ++p)
+    {
+      if (p->first >= 0) // unset captures are -1
+      {
+        p->first  -= match.line_begin;
+        p->second -= match.line_begin;
+      }
+    }
+
+    match.captures.swap(captures);
+
+    if (multiple_)
+    {
+      last_was_empty_ = (start == stop);
+      offset_ = stop;
+    }
+    else if (line_end_ < size_)
+    {
+      // Match every line only once, and go on with the next one.
+      last_was_empty_ = false;
+      offset_ = std::max(next_line_, stop);
+    }
+    else // this was the last line
+    {
+      done_ = true;
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * The regex only gets to see the current line, so the capture bounds are
+ * relative to its start already.
+ */
+bool TextScanner::next_match_in_line(ScanMatch& match)
+{
+  while (!is_cancelled())
+  {
+    GMatchInfo* match_info = 0;
+
+    const bool is_matched =
+      g_regex_match_full(regex_, text_ + line_begin_, line_end_ - line_begin_,
+                         offset_ - line_begin_,
+                         (last_was_empty_) ? GRegexMatchFlags(G_REGEX_MATCH_ANCHORED
+                                                              | G_REGEX_MATCH_NOTEMPTY)
+                                           : GRegexMatchFlags(0),
+                         &match_info, 0);
+    if (!is_matched)
+    {
+      g_match_info_free(match_info);
+
+      if (last_was_empty_ && offset_ < line_end_)
+      {
+        offset_ = g_utf8_next_char(text_ + offset_) - text_;
+        last_was_empty_ = false;
+        continue;
+      }
+
+      if (!next_line())
+        break;
+
+      continue;
+    }
+
+    Util::CaptureVector captures;
+    fetch_captures(match_info, captures);
+    g_match_info_free(match_info);
+
+    match.line       = line_;
+    match.line_begin = line_begin_;
+    match.line_end   = line_end_;
+
+    const size_type start = line_begin_ + captures.front().first;
+    const size_type stop  = line_begin_ + captures.front().second;
+
+    match.captures.swap(captures);
+
+    if (multiple_)
+    {
+      last_was_empty_ = (start == stop);
+      offset_ = stop;
+    }
+    else if (!next_line())
+    {
+      done_ = true;
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+} // anonymous namespace
+
+namespace Regexxer
+{
+
+bool is_same_pattern(const Glib::RefPtr<Glib::Regex>& a, const Glib::RefPtr<Glib::Regex>& b)
+{
+  return (a == b || (a && b && a->get_pattern() == b->get_pattern()
+                     && a->get_compile_flags() == b->get_compile_flags()));
+}
+
+bool is_multiline_pattern(const Glib::RefPtr<Glib::Regex>& pattern)
+{
+  return ((pattern->get_compile_flags() & Glib::REGEX_MULTILINE) != 0);
+}
+
+int scan_text(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+              const std::string& text, ScanMatchList& matches,
+              const sigc::slot<bool>& pulse)
+{
+  g_return_val_if_fail(is_scannable_size(text.size()), 0);
+
+  TextScanner scanner (pattern, multiple, text.data(), text.size(),
+                       0, 0, text.size(), pulse);
+  int match_count = 0;
+
+  for (;;)
+  {
+    matches.push_back(ScanMatch());
+
+    if (!scanner.next_match(matches.back()))
+    {
+      matches.pop_back();
+      break;
+    }
+    ++match_count;
+  }
+
+  return match_count;
+}
+
+int scan_text_lines(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                    const std::string& text, int first_line,
+                    std::size_t begin, std::size_t end,
+                    ScanMatchList& matches)
+{
+  g_return_val_if_fail(is_scannable_size(text.size()), 0);
+  g_return_val_if_fail(begin <= end && end <= text.size(), 0);
+
+  TextScanner scanner (pattern, multiple, text.data(), text.size(),
+                       begin, first_line, end, sigc::slot<bool>());
+  int match_count = 0;
+
+  for (;;)
+  {
+    matches.push_back(ScanMatch());
+
+    if (!scanner.next_match(matches.back()))
+    {
+      matches.pop_back();
+      break;
+    }
+    ++match_count;
+  }
+
+  return match_count;
+}
+
+std::string substitute_text(const std::string& text, const ScanMatchList& matches,
+                            const Glib::ustring& substitution)
+{
+  std::string   result;
+  Glib::ustring subject;
+  int           subject_line = -1;
+  size_type     subject_end  = std::string::npos;
+  size_type     pos = 0;
+
+  result.reserve(text.size());
+
+  for (ScanMatchList::const_iterator p = matches.begin(); p != matches.end(); ++p)
+  {
+    // Matches spanning several lines have a longer subject than the
+    // other matches starting in the same line.
+    if (p->line != subject_line || p->line_end != subject_end)
+    {
+      subject.assign(text.begin() + p->line_begin, text.begin() + p->line_end);
+      subject_line = p->line;
+      subject_end  = p->line_end;
+    }
+
+    const size_type start = p->line_begin + p->captures.front().first;
+    const size_type stop  = p->line_begin + p->captures.front().second;
+
+    g_return_val_if_fail(start >= pos && stop <= text.size(), text);
+
+    result.append(text, pos, start - pos);
+    result += Util::substitute_references(substitution, subject, p->captures).raw();
+    pos = stop;
+  }
+
+  result.append(text, pos, std::string::npos);
+
+  return result;
+}
+
+int stream_substitute(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                      const char* text, std::size_t size, const Glib::ustring& substitution,
+                      const sigc::slot<void, const char*, std::size_t>& output,
+                      const sigc::slot<void, int, const Glib::ustring&>& feedback)
+{
+  g_return_val_if_fail(is_scannable_size(size), -1);
+
+  TextScanner   scanner (pattern, multiple, text, size, 0, 0, size, sigc::slot<bool>());
+  ScanMatch     match;
+  Glib::ustring subject;
+  int           feedback_line = -1;
+  int           match_count   = 0;
+  size_type     pos = 0;
+
+  while (scanner.next_match(match))
+  {
+    const size_type start = match.line_begin + match.captures.front().first;
+    const size_type stop  = match.line_begin + match.captures.front().second;
+
+    // Copy only the part of the line the captures cover, rather than the
+    // whole subject, so that memory use doesn't grow with the line length.
+    int span_begin = match.captures.front().first;
+    int span_end   = match.captures.front().second;
+
+    for (Util::CaptureVector::const_iterator p = match.captures.begin();
+         p != match.captures.end(); ++p)
+    {
+      if (p->first >= 0) // unset captures are -1
+      {
+        span_begin = std::min(span_begin, p->first);
+        span_end   = std::max(span_end,   p->second);
+      }
+    }
+
+    for (Util::CaptureVector::iterator p = match.captures.begin(); p != match.captures.end(); ++p)
+    {
+      if (p->first >= 0)
+      {
+        p->first  -= span_begin;
+        p->second -= span_begin;
+      }
+    }
+
+    subject.assign(text + match.line_begin + span_begin, text + match.line_begin + span_end);
+
+    const Glib::ustring replacement =
+        Util::substitute_references(substitution, subject, match.captures);
+
+    output(text + pos, start - pos);
+
+    // Not before the text up to the match has been accepted, so that a
+    // caller whose output fails at first can start over without reporting
+    // the line twice.
+    if (match.line != feedback_line && feedback)
+    {
+      feedback(match.line, Glib::ustring(text + match.line_begin, text + match.line_end));
+      feedback_line = match.line;
+    }
+
+    output(replacement.data(), replacement.bytes());
+
+    pos = stop;
+    ++match_count;
+  }
+
+  if (match_count > 0)
+    output(text + pos, size - pos);
+
+  return match_count;
+}
+
+} // namespace Regexxer
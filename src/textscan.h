@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef REGEXXER_TEXTSCAN_H_INCLUDED
+#define REGEXXER_TEXTSCAN_H_INCLUDED
+
+#include "stringutils.h"
+
+#include <glib.h>
+#include <glibmm/refptr.h>
+#include <glibmm/regex.h>
+#include <glibmm/ustring.h>
+#include <sigc++/sigc++.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Regexxer
+{
+
+/*
+ * A match found by scan_text(), described by plain byte offsets so that
+ * no GTK+ object is needed to compute it.  The line is identified by its
+ * number and the byte range [line_begin,line_end) of the scanned text,
+ * excluding the line terminator.  A match that spans several lines has a
+ * range that extends to the end of the line it ends in.  The capture
+ * bounds are byte offsets relative to line_begin, which fit into an int
+ * because the text scanned is always shorter than G_MAXINT bytes.
+ */
+struct ScanMatch
+{
+  int                 line;
+  std::size_t         line_begin;
+  std::size_t         line_end;
+  Util::CaptureVector captures;
+};
+
+typedef std::vector<ScanMatch> ScanMatchList;
+
+/*
+ * Whether a text of the given size can be scanned at all.  GRegex takes
+ * byte offsets of type gint, so larger texts have to be refused upfront.
+ */
+inline bool is_scannable_size(std::size_t size)
+{
+  return (size < std::size_t(G_MAXINT));
+}
+
+/*
+ * The compile flags a pattern passed to scan_text() should have.  By default
+ * every line is searched on its own.  A multiline pattern is run over the
+ * text as a whole instead, so that matches may span several lines.  Then ^
+ * and $ have to match at every line boundary, including those marked by
+ * "\r\n" or "\r".
+ */
+inline Glib::RegexCompileFlags get_scan_compile_flags(bool multiline)
+{
+  if (!multiline)
+    return static_cast<Glib::RegexCompileFlags>(0);
+
+#if GLIB_CHECK_VERSION(2, 34, 0)
+  return static_cast<Glib::RegexCompileFlags>(G_REGEX_MULTILINE | G_REGEX_NEWLINE_ANYCRLF);
+#else
+  return Glib::REGEX_MULTILINE;
+#endif
+}
+
+/*
+ * Whether the pattern has been compiled for a multiline search.
+ */
+bool is_multiline_pattern(const Glib::RefPtr<Glib::Regex>& pattern);
+
+/*
+ * Whether two compiled patterns are the same expression with the same
+ * flags, and thus find the same matches.
+ */
+bool is_same_pattern(const Glib::RefPtr<Glib::Regex>& a, const Glib::RefPtr<Glib::Regex>& b);
+
+/*
+ * Apply pattern on the UTF-8 encoded text and append the matches found to
+ * the list.  Only a multiline pattern is run over the text as a whole, so
+ * that a match may span several lines.  The line numbers are counted the
+ * same way as Gtk::TextBuffer does it, so that the matches can be installed
+ * into a FileBuffer.  If multiple is false then at most one match starts in
+ * every line.  Returns the number of new matches.  The text must not be
+ * larger than is_scannable_size() allows.
+ *
+ * If pulse is not empty, it is called every few hundred runs of the regex,
+ * and the scan stops early if it returns true.
+ */
+int scan_text(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+              const std::string& text, ScanMatchList& matches,
+              const sigc::slot<bool>& pulse = sigc::slot<bool>());
+
+/*
+ * Like scan_text(), but only look for matches that start in the lines from
+ * byte offset begin up to end, both of which have to be line starts or the
+ * end of the text.  The line at begin has the number first_line.  The rest
+ * of the text is still visible to a multiline pattern, so that anchors
+ * and lookaround assertions work as usual.
+ */
+int scan_text_lines(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                    const std::string& text, int first_line,
+                    std::size_t begin, std::size_t end,
+                    ScanMatchList& matches);
+
+/*
+ * Return a copy of text with every match replaced by substitution, after
+ * interpolating references to captured substrings.  The match list must
+ * have been built by scan_text() from the very same text.
+ */
+std::string substitute_text(const std::string& text, const ScanMatchList& matches,
+                            const Glib::ustring& substitution);
+
+/*
+ * Substitute every match of pattern in the UTF-8 encoded text of the given
+ * size, and pass the result to output piece by piece as it becomes ready.
+ * The outcome is the same as that of scan_text() and substitute_text(), but
+ * neither the matches nor the new text are ever held in memory as a whole.
+ * If feedback is not empty, it is called for the first match of every line,
+ * once the text before the match has been output.  Nothing is output if
+ * there is no match.  Returns the number of matches,
+ * or -1 if the text is too large to be scanned.
+ */
+int stream_substitute(const Glib::RefPtr<Glib::Regex>& pattern, bool multiple,
+                      const char* text, std::size_t size, const Glib::ustring& substitution,
+                      const sigc::slot<void, const char*, std::size_t>& output,
+                      const sigc::slot<void, int, const Glib::ustring&>& feedback);
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_TEXTSCAN_H_INCLUDED */
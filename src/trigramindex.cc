@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "trigramindex.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glibmm/checksum.h>
+#include <glibmm/convert.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
+#include <algorithm>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <config.h>
+
+namespace
+{
+
+// Identifies the file format.  Increment the version on any change.
+const char index_magic[] = "regexxer trigram index 3\n";
+
+// Number of unsorted trigrams collected before duplicates are removed,
+// to keep memory usage at bay while processing big files.
+enum { COMPACT_THRESHOLD = 1 << 16 };
+
+inline
+guint32 fold_byte(char c)
+{
+  return static_cast<unsigned char>(g_ascii_tolower(c));
+}
+
+static
+void compact_trigrams(Regexxer::TrigramSet& trigrams)
+{
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+/*
+ * Append the trigrams of text to the unsorted set.
+ */
+static
+void add_trigrams(const std::string& text, Regexxer::TrigramSet& trigrams)
+{
+  if (text.size() < 3)
+    return;
+
+  std::string::size_type limit = trigrams.size() + COMPACT_THRESHOLD;
+  guint32 key = (fold_byte(text[0]) << 8) | fold_byte(text[1]);
+
+  for (std::string::size_type i = 2; i < text.size(); ++i)
+  {
+    key = ((key << 8) | fold_byte(text[i])) & 0xFFFFFF;
+    trigrams.push_back(key);
+
+    if (trigrams.size() >= limit)
+    {
+      compact_trigrams(trigrams);
+      limit = 2 * trigrams.size() + COMPACT_THRESHOLD;
+    }
+  }
+}
+
+/*
+ * The index is stored as a sequence of variable-length integers, and the
+ * trigrams of each file as differences to their predecessors.  That makes
+ * the file several times smaller than a plain array of integers.
+ */
+static
+void append_number(std::string& data, guint64 value)
+{
+  while (value >= 0x80)
+  {
+    data += char((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+
+  data += char(value);
+}
+
+static
+void append_string(std::string& data, const std::string& value)
+{
+  append_number(data, value.size());
+  data += value;
+}
+
+static
+bool read_number(const char*& pos, const char* end, guint64& value)
+{
+  value = 0;
+
+  for (unsigned int shift = 0; pos != end && shift < 64; shift += 7)
+  {
+    const unsigned char c = *pos++;
+    value |= guint64(c & 0x7F) << shift;
+
+    if ((c & 0x80) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+static
+bool read_string(const char*& pos, const char* end, std::string& value)
+{
+  guint64 size = 0;
+
+  if (!read_number(pos, end, size) || size > guint64(end - pos))
+    return false;
+
+  value.assign(pos, pos + size);
+  pos += size;
+
+  return true;
+}
+
+} // anonymous namespace
+
+namespace Regexxer
+{
+
+/**** Regexxer::TrigramIndex ***********************************************/
+
+TrigramIndex::TrigramIndex(const std::string& toplevel, const std::string& fallback_encoding)
+:
+  toplevel_          (toplevel),
+  fallback_encoding_ (fallback_encoding),
+  charset_           (),
+  cache_filename_    (),
+  entries_           (),
+  loaded_            (false),
+  dirty_             (false)
+{
+  Glib::get_charset(charset_);
+
+
+  // One index file per toplevel directory, named after its checksum.
+  cache_filename_ = Glib::build_filename(
+      Glib::get_user_cache_dir(), PACKAGE_TARNAME, "index",
+      Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, toplevel));
+}
+
+TrigramIndex::~TrigramIndex()
+{}
+
+void TrigramIndex::load()
+{
+  if (loaded_)
+    return;
+
+  loaded_ = true;
+
+  std::string data;
+
+  try
+  {
+    data = Glib::file_get_contents(cache_filename_);
+  }
+  catch (const Glib::FileError&)
+  {
+    return; // no index yet
+  }
+
+  if (!parse(data))
+  {
+    g_warning("Discarding corrupt search index \"%s\"", cache_filename_.c_str());
+    entries_.clear();
+  }
+}
+
+void TrigramIndex::save()
+{
+  if (!dirty_)
+    return;
+
+  prune();
+
+  std::string data (index_magic);
+
+  append_string(data, toplevel_);
+  append_string(data, charset_);
+  append_string(data, fallback_encoding_);
+  append_number(data, entries_.size());
+
+  for (EntryMap::const_iterator p = entries_.begin(); p != entries_.end(); ++p)
+  {
+    const TrigramSet& trigrams = p->second.trigrams;
+
+    append_string(data, p->first);
+    append_number(data, p->second.stamp.mtime);
+    append_number(data, p->second.stamp.ctime);
+    append_number(data, p->second.stamp.size);
+    append_number(data, p->second.stamp.inode);
+    append_number(data, trigrams.size());
+
+    guint32 previous = 0;
+
+    for (TrigramSet::const_iterator t = trigrams.begin(); t != trigrams.end(); ++t)
+    {
+      append_number(data, *t - previous);
+      previous = *t;
+    }
+  }
+
+  const std::string dirname = Glib::path_get_dirname(cache_filename_);
+  GError* error = 0;
+
+  // g_file_set_contents() writes to a temporary file and renames it, so
+  // that a concurrent instance never sees a partially written index.
+  if (g_mkdir_with_parents(dirname.c_str(), 0700) < 0
+      || !g_file_set_contents(cache_filename_.c_str(), data.data(), data.size(), &error))
+  {
+    g_warning("Failed to write search index \"%s\": %s", cache_filename_.c_str(),
+              (error) ? error->message : g_strerror(errno));
+    if (error)
+      g_error_free(error);
+    return;
+  }
+
+  dirty_ = false;
+}
+
+bool TrigramIndex::lookup(const std::string& filename, const FileStamp& stamp,
+                          const TrigramSet& query, bool& may_match)
+{
+  const EntryMap::iterator pos = entries_.find(filename);
+
+  if (pos == entries_.end())
+    return false;
+
+  pos->second.seen = true;
+
+  if (!(pos->second.stamp == stamp))
+    return false;
+
+  const TrigramSet& trigrams = pos->second.trigrams;
+
+  may_match = std::includes(trigrams.begin(), trigrams.end(), query.begin(), query.end());
+
+  return true;
+}
+
+void TrigramIndex::update(const std::string& filename, const FileStamp& stamp,
+                          TrigramSet& trigrams)
+{
+  Entry& entry = entries_[filename];
+
+  entry.stamp = stamp;
+  entry.trigrams.swap(trigrams);
+  entry.seen = true;
+
+  dirty_ = true;
+}
+
+// static
+bool TrigramIndex::get_file_stamp(const std::string& filename, FileStamp& stamp)
+{
+  struct stat info;
+
+  if (stat(filename.c_str(), &info) < 0)
+    return false;
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+  stamp.mtime = gint64(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+  stamp.ctime = gint64(info.st_ctim.tv_sec) * 1000000000 + info.st_ctim.tv_nsec;
+#else
+  stamp.mtime = gint64(info.st_mtime) * 1000000000;
+  stamp.ctime = gint64(info.st_ctime) * 1000000000;
+#endif
+  stamp.size  = info.st_size;
+  stamp.inode = info.st_ino;
+
+  return true;
+}
+
+// static
+void TrigramIndex::get_text_trigrams(const std::string& text, TrigramSet& trigrams)
+{
+  trigrams.clear();
+  add_trigrams(text, trigrams);
+  compact_trigrams(trigrams);
+}
+
+// static
+void TrigramIndex::get_literal_trigrams(const std::vector<std::string>& literals,
+                                        TrigramSet& trigrams)
+{
+  trigrams.clear();
+
+  for (std::vector<std::string>::const_iterator p = literals.begin(); p != literals.end(); ++p)
+    add_trigrams(*p, trigrams);
+
+  compact_trigrams(trigrams);
+}
+
+/**** Regexxer::TrigramIndex -- private ************************************/
+
+bool TrigramIndex::parse(const std::string& data)
+{
+  const std::string::size_type magic_size = sizeof(index_magic) - 1;
+
+  if (data.compare(0, magic_size, index_magic) != 0)
+    return false;
+
+  const char* pos = data.data() + magic_size;
+  const char *const end = data.data() + data.size();
+
+  std::string toplevel;
+  std::string charset;
+  std::string fallback_encoding;
+  guint64     count = 0;
+
+  // Two directories might have the same checksum, after all.
+  if (!read_string(pos, end, toplevel) || toplevel != toplevel_
+      || !read_string(pos, end, charset) || !read_string(pos, end, fallback_encoding)
+      || !read_number(pos, end, count))
+    return false;
+
+  // Files decoded with other encodings have different trigrams, so an
+  // index built with those might rule out files which actually match.
+  // Start over with an empty index, which replaces it on the next save.
+  if (charset != charset_ || fallback_encoding != fallback_encoding_)
+    return true;
+
+  for (; count > 0; --count)
+  {
+    std::string filename;
+    guint64     mtime = 0;
+    guint64     ctime = 0;
+    guint64     size  = 0;
+    guint64     inode = 0;
+    guint64     trigram_count = 0;
+
+    if (!read_string(pos, end, filename) || !read_number(pos, end, mtime)
+        || !read_number(pos, end, ctime) || !read_number(pos, end, size)
+        || !read_number(pos, end, inode) || !read_number(pos, end, trigram_count)
+        || trigram_count > guint64(end - pos)) // at least one byte each
+      return false;
+
+    Entry& entry = entries_[filename];
+
+    entry.stamp.mtime = mtime;
+    entry.stamp.ctime = ctime;
+    entry.stamp.size  = size;
+    entry.stamp.inode = inode;
+    entry.trigrams.reserve(trigram_count);
+
+    guint64 trigram = 0;
+
+    for (; trigram_count > 0; --trigram_count)
+    {
+      guint64 delta = 0;
+
+      if (!read_number(pos, end, delta))
+        return false;
+
+      trigram += delta;
+      entry.trigrams.push_back(trigram);
+    }
+  }
+
+  return (pos == end);
+}
+
+/*
+ * Drop the entries of files which have been deleted.  Those the searches
+ * came across are known to exist, so only the others need to be checked.
+ */
+void TrigramIndex::prune()
+{
+  EntryMap::iterator p = entries_.begin();
+
+  while (p != entries_.end())
+  {
+    struct stat info;
+
+    if (!p->second.seen && stat(p->first.c_str(), &info) < 0
+        && (errno == ENOENT || errno == ENOTDIR))
+      entries_.erase(p++);
+    else
+      ++p;
+  }
+}
+
+} // namespace Regexxer
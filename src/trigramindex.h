@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2002-2007  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of regexxer.
+ *
+ * regexxer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * regexxer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with regexxer; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef REGEXXER_TRIGRAMINDEX_H_INCLUDED
+#define REGEXXER_TRIGRAMINDEX_H_INCLUDED
+
+#include <glib.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Regexxer
+{
+
+/*
+ * A sorted set of trigrams, each one packed into the lower 24 bits of an
+ * integer.  ASCII letters are folded to lowercase, so that a single index
+ * serves both case-sensitive and caseless searches.
+ */
+typedef std::vector<guint32> TrigramSet;
+
+/*
+ * What the index remembers of a file in order to tell whether its entry
+ * is still up-to-date.  The times are in nanoseconds where the system
+ * supports it.  The change time and inode number catch modifications that
+ * keep the modification time, as well as files replaced by another one.
+ */
+struct FileStamp
+{
+  gint64  mtime;
+  gint64  ctime;
+  gint64  size;
+  guint64 inode;
+
+  FileStamp() : mtime (0), ctime (0), size (0), inode (0) {}
+
+  bool is_set() const { return (mtime != 0 || ctime != 0 || size != 0 || inode != 0); }
+
+  bool operator==(const FileStamp& other) const
+    { return (mtime == other.mtime && ctime == other.ctime
+              && size == other.size && inode == other.inode); }
+};
+
+/*
+ * The trigrams of every file searched below a toplevel directory, stored in
+ * the user's cache directory.  Before a file is read, its trigrams can be
+ * checked against those of the literal substrings a regular expression
+ * requires, and the file skipped altogether if some of them are missing.
+ *
+ * The index is only a hint:  entries whose stamp doesn't match the file
+ * anymore are ignored and replaced by the next search, and a file whose
+ * entry is missing simply has to be read.  The trigrams are taken from the
+ * text after conversion to UTF-8, so an index is only valid for the
+ * encodings it was built with; one built with others is discarded when
+ * loaded.  All methods must be called from the main thread.
+ */
+class TrigramIndex
+{
+public:
+  TrigramIndex(const std::string& toplevel, const std::string& fallback_encoding);
+  ~TrigramIndex();
+
+  const std::string& get_toplevel() const { return toplevel_; }
+  const std::string& get_fallback_encoding() const { return fallback_encoding_; }
+
+  // Read the index from the cache unless that has been done already.
+  void load();
+
+  // Write the index back to the cache if it has been changed.  Entries of
+  // files that have neither been looked up nor updated since the index was
+  // loaded are dropped if the file doesn't exist anymore.
+  void save();
+
+  // Returns false if there is no entry for the file that matches stamp.
+  // Otherwise, may_match is set to whether the file contains all trigrams
+  // of the query.
+  bool lookup(const std::string& filename, const FileStamp& stamp,
+              const TrigramSet& query, bool& may_match);
+
+  // Store the trigrams of the file.  The set is swapped into the index.
+  void update(const std::string& filename, const FileStamp& stamp, TrigramSet& trigrams);
+
+  static bool get_file_stamp(const std::string& filename, FileStamp& stamp);
+
+  // These two are thread-safe.
+  static void get_text_trigrams(const std::string& text, TrigramSet& trigrams);
+  static void get_literal_trigrams(const std::vector<std::string>& literals,
+                                   TrigramSet& trigrams);
+
+private:
+  struct Entry
+  {
+    FileStamp  stamp;
+    TrigramSet trigrams;
+    bool       seen;      // by the searches since loading
+
+    Entry() : stamp (), trigrams (), seen (false) {}
+  };
+
+  typedef std::map<std::string, Entry> EntryMap;
+
+  std::string toplevel_;
+  std::string fallback_encoding_;
+  std::string charset_;           // of the locale, tried before the fallback
+  std::string cache_filename_;
+  EntryMap    entries_;
+  bool        loaded_;
+  bool        dirty_;
+
+  TrigramIndex(const TrigramIndex&);
+  TrigramIndex& operator=(const TrigramIndex&);
+
+  bool parse(const std::string& data);
+  void prune();
+};
+
+} // namespace Regexxer
+
+#endif /* REGEXXER_TRIGRAMINDEX_H_INCLUDED */
@@ -25,8 +25,6 @@
 namespace
 {
 
-enum { PULSE_INTERVAL = 8 };
-
 class StopUndo {};
 
 } // anonymous namespace
@@ -89,7 +87,6 @@ void UndoStack::undo_step(const sigc::slot<bool>& pulse)
 
 bool UndoStack::do_undo(const sigc::slot<bool>& pulse)
 {
-  unsigned int iteration = 0;
   bool skip = true;
 
   while (!actions_.empty())
@@ -101,7 +98,7 @@ bool UndoStack::do_undo(const sigc::slot<bool>& pulse)
     {
       skip = false;
 
-      if ((++iteration % PULSE_INTERVAL) == 0 && pulse())
+      if (pulse())
         throw StopUndo();
     }
   }